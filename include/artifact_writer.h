@@ -0,0 +1,29 @@
+#ifndef ARTIFACT_WRITER_H
+#define ARTIFACT_WRITER_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+// Collects the files a run produces (program, listing, symbols, cross-reference, profile) and
+// writes them together at the end. Where io_uring is available, every write is queued on one ring
+// with the buffers registered, and the writer waits once for all of them; elsewhere, or if the
+// ring cannot be set up, the files are written one after another with blocking writes.
+class ArtifactWriter {
+public:
+    // Queues a file. Adding a file name again replaces the contents queued for it.
+    void add(const std::string& filename, std::string contents);
+    // Writes and forgets every added artifact. Returns false if any could not be written;
+    // their names are appended to `failed`.
+    bool flush(std::vector<std::string>& failed);
+
+private:
+    struct Artifact {
+        std::string filename;
+        std::string contents;
+    };
+    std::vector<Artifact> artifacts;
+    std::unordered_map<std::string, size_t> positions;  // Index in artifacts of each file name.
+};
+
+#endif // ARTIFACT_WRITER_H
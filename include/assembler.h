@@ -5,14 +5,177 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <set>
+#include <memory>
+#include <chrono>
+#include <functional>
 #include <cstdint>
+#include "instructions.h"
+#include "line_table.h"
+
+// One piece of a compiled macro body line. Literal text is copied as-is,
+// parameter and LOCAL slots are filled in when the macro is expanded.
+struct MacroSegment {
+    enum Kind { TEXT, PARAM, LOCAL };
+    Kind kind;
+    std::string text;                   // Literal text (TEXT segments only).
+    int slot;                           // Index into the arguments or the local labels.
+};
 
 // Holds the definition of a user-defined macro, including its name,
 // the list of parameter names, and the lines of code in its body.
+// The body is compiled into template_lines once, when the macro is defined.
 struct Macro {
     std::string name;
     std::vector<std::string> params;
+    std::vector<std::string> locals;    // Label names declared with LOCAL.
     std::vector<std::string> body_lines;
+    std::vector<std::vector<MacroSegment>> template_lines;
+    std::vector<size_t> block_ends;     // For a template line opening REPT/IRP/IRPC, its ENDM line; otherwise 0.
+};
+
+// A memoized expansion of a macro for one argument tuple. When every expanded line is
+// replayable (no '$', labels, conditionals, DS or nested macros) the byte size and the
+// encoded bytes are recorded, so repeated invocations skip parsing altogether.
+struct ExpansionCacheEntry {
+    std::vector<std::string> lines;     // The expanded body lines.
+    bool replayable = true;
+    bool recorded[2] = { false, false }; // Whether pass 1 / pass 2 results have been captured.
+    uint16_t size = 0;                  // Bytes the expansion occupies.
+    std::vector<uint8_t> bytes;         // Encoded bytes from pass 2.
+    std::vector<std::string> xrefs[2];  // Symbols referenced in pass 1 / pass 2, for the cross-reference.
+};
+
+struct MacroLibrary;
+
+// A run of written addresses in the output image. `size` can be 65536, so it is wider than an address.
+struct AddressRange {
+    uint16_t start;
+    uint32_t size;
+};
+
+// Supplies the memory pass 2 encodes the program into when it goes straight into a file mapping
+// (--mmap-output): called with the number of bytes pass 1 laid out, returns their storage or null.
+using OutputMapper = std::function<uint8_t*(size_t size)>;
+
+// Expansion statistics for one macro, collected with --macro-profile. Lines, bytes and
+// time are inclusive: whatever nested expansions produce is charged to the outer macro too.
+struct MacroProfile {
+    uint64_t invocations = 0;
+    uint64_t lines = 0;                 // Expanded lines produced.
+    uint64_t bytes = 0;                 // Bytes emitted in pass 2.
+    double seconds = 0;                 // Time spent expanding, over both passes.
+    int active = 0;                     // Open frames of this macro; recursion is only charged once.
+};
+
+// Budgets that stop runaway expansion (e.g. a macro invoking itself with no terminating IF)
+// before it exhausts time or memory. Lines and bytes are counted per pass.
+struct ExpansionLimits {
+    size_t max_depth = 1000;            // Nested macro and repeat-block frames.
+    uint64_t max_lines = 10000000;      // Lines produced by expansion.
+    uint64_t max_bytes = 1048576;       // Bytes of code and data emitted.
+};
+
+// A line handed from the expansion engine to the pass driver. The text is not copied:
+// it points at the source, a cached expansion, or the engine's splice buffer.
+struct LineRecord {
+    const std::string* text;
+    int source_line;                    // Source line that produced this line.
+    int depth;                          // Macro expansion depth (0 = the source line itself).
+};
+
+// What pass 0 learned about a source line, so the passes can find block structure without
+// tokenizing the line again. `end` is the line closing the block the line opens: the ENDM of
+// MACRO/REPT/IRP/IRPC, the ELSE or ENDIF of IF, the ENDIF of ELSE; -1 when there is none.
+// `cpu` is the instruction set selected by the .8080/.8085U/.Z80 lines above it, read top to bottom.
+struct SourceLine {
+    enum Kind { BLANK, STATEMENT, MACRO_DEF, REPEAT_BLOCK, CONDITIONAL };
+    Kind kind = STATEMENT;
+    int end = -1;
+    Cpu cpu = Cpu::I8080;
+};
+
+// An open IF block.
+struct ConditionalBlock {
+    bool active;                        // Whether the current branch assembles (ignoring enclosing blocks).
+    bool in_else;                       // Set once ELSE has been seen.
+};
+
+// A source line split into its fields (labels and mnemonics lowercased).
+struct ParsedLine {
+    std::string label, mnemonic, operand1, operand2, comment;
+};
+
+ParsedLine parse_line(std::string line);
+
+// The pass-1 effect of a line whose size does not depend on any symbol. size is -1 for
+// lines that have to go through the serial pass.
+struct LineSize {
+    int size = -1;
+    std::string label;
+};
+
+// Everything pass 0 derives from a source: its lines, their block structure, the compiled
+// macros and the pre-expanded macro calls. None of it depends on symbol values, so one
+// prepared source can be assembled any number of times, concurrently (e.g. once per variant).
+struct PreparedSource {
+    std::vector<std::string> lines;
+    std::vector<SourceLine> index;
+    std::map<std::string, Macro> macros;
+    std::map<std::string, uint16_t> equates;   // Library equates every assembly starts from.
+    std::map<std::string, ExpansionCacheEntry> expansions; // Seeds the expansion cache of each assembly.
+    std::vector<LineSize> sizes;        // Pre-sized top-level lines, for pass 1.
+};
+
+// The state of pass 1 at the start of a source line. Pass 2 workers start from these.
+struct PassCheckpoint {
+    int line;
+    uint16_t address;
+    int macro_expansion_counter;
+    uint64_t expanded_lines;
+    uint64_t pass_bytes;
+    std::vector<ConditionalBlock> if_stack;
+    size_t inactive_blocks;
+    Cpu cpu;
+    size_t branch_ordinal;
+};
+
+// A JR or DJNZ left short in pass 1, checked against its target once the pass has defined every symbol.
+struct BranchSite {
+    size_t ordinal;                     // Position among the relative branches of the pass.
+    uint16_t address;                   // Location counter after the branch, the value of '$' in its operand.
+    std::string target;
+    int line;
+};
+
+// One level of macro or repeat-block expansion. Frames live on an explicit stack, so
+// deep nesting costs one small frame per level rather than a recursive call with copied strings.
+struct ExpansionFrame {
+    const Macro* macro = nullptr;       // Template being spliced, or null when running cached lines.
+    const Macro* origin = nullptr;      // Macro or repeat block being expanded, for backtraces.
+    const std::vector<std::string>* lines = nullptr; // Already-expanded lines from the expansion cache.
+    std::shared_ptr<const Macro> owner; // Keeps repeat blocks compiled during expansion alive.
+    std::vector<std::string> args;
+    std::vector<std::string> local_names;
+    std::vector<std::string> items;     // IRP/IRPC arguments, one per iteration.
+    int iterations = 1;
+    int iteration = 0;
+    size_t next_line = 0;
+    ExpansionCacheEntry* recording = nullptr; // Cache entry to fill in when the frame finishes.
+    uint16_t start_address = 0;
+    size_t start_output = 0;
+    MacroProfile* profile = nullptr;    // Set when profiling, for the frame of a macro call.
+    std::chrono::steady_clock::time_point profile_start;
+    uint64_t profile_lines = 0;
+    size_t profile_bytes = 0;
+};
+
+// Which optional outputs a pass produces. The pass driver is instantiated once per combination,
+// so a pass without a listing carries none of its code in its loop.
+template <bool Listing, bool Octal>
+struct PassPolicy {
+    static constexpr bool listing = Listing;    // Write the listing (pass 2 with a listing stream).
+    static constexpr bool octal = Octal;        // List addresses and bytes in octal.
 };
 
 // The main class that encapsulates all the logic for the cross-assembler.
@@ -21,11 +184,31 @@ public:
     // *** Public Interface ***
     Assembler();
     void assemble(const std::vector<std::string>& lines);
+    std::shared_ptr<const PreparedSource> prepare(const std::vector<std::string>& lines);
+    void assemble(std::shared_ptr<const PreparedSource> prepared);
+    bool define_symbol(const std::string& definition);
+    void set_error_prefix(const std::string& prefix);
+    void set_throw_errors(bool enabled);    // Throw errors as std::runtime_error instead of exiting.
     const std::vector<uint8_t>& getOutput() const;
+    uint16_t getOutputOrigin() const;
+    size_t getOutputSize() const;
+    void copy_output(uint8_t* destination) const;
+    void set_output_mapper(OutputMapper mapper);
+    bool is_output_mapped() const;
+    void set_line_table(bool enabled);
+    const std::vector<LineTableEntry>& getLineTable() const;
+    std::vector<AddressRange> getOutputRanges() const;
     const std::map<std::string, uint16_t>& getSymbolTable() const;
     void set_listing_stream(std::ostream& stream);
     void set_octal_mode(bool enabled);
+    void set_cross_reference(bool enabled);
     const std::map<std::string, std::vector<int>>& getCrossReferenceData() const;
+    void add_macro_library(const MacroLibrary& library);
+    MacroLibrary build_macro_library() const;
+    void set_macro_profiling(bool enabled);
+    void set_expansion_limits(const ExpansionLimits& new_limits);
+    void set_thread_count(unsigned count);
+    const std::map<std::string, MacroProfile>& getMacroProfile() const;
 
 private:
     // *** State Variables ***
@@ -36,10 +219,57 @@ private:
     int source_pass;                    // Which pass we are on (1 or 2).
     bool assembly_finished;             // Flag set by the END directive.
     int macro_expansion_counter;        // Counter to generate unique local labels.
-    std::vector<uint8_t> output;        // The generated machine code.
+    std::vector<uint8_t> image;         // The 64 KiB address space, written in pass 2 at the location counter (unless mapped).
+    uint8_t* window = nullptr;          // Storage of addresses window_start onwards: the image, or the output mapping.
+    uint16_t window_start = 0;
+    uint32_t window_size = 0;
+    OutputMapper output_mapper;
+    bool output_mapped = false;         // Whether pass 2 writes into the output mapper's memory.
+    uint32_t span_start = 0;            // Lowest address pass 1 laid out bytes at.
+    uint32_t span_end = 0;              // End of the highest; past 0x10000 when the bytes wrap around.
+    std::vector<uint64_t> coverage;     // One bit per image byte that has been written.
+    uint16_t emit_address = 0;          // Where the next emitted byte goes.
+    uint64_t emitted_bytes = 0;         // Bytes emitted so far in pass 2.
+    uint64_t line_emit_mark = 0;        // emitted_bytes when the current source line started, for the listing.
+    uint16_t line_emit_address = 0;     // Where the current source line's first byte went.
+    std::vector<uint8_t> output;        // The generated machine code, extracted from the image after pass 2 (empty when mapped).
+    uint16_t output_origin = 0;         // Address of output[0].
+    size_t output_size = 0;             // Bytes from output_origin to the last written address.
+    bool line_table_enabled = false;    // Whether pass 2 records which line emitted each address (-g).
+    std::vector<LineTableEntry> line_table; // Runs of addresses per source line and depth, sorted after pass 2.
+    int replay_depth = 0;               // 1 while a cached expansion's bytes are replayed from its caller's depth.
     std::map<std::string, uint16_t> symbol_table; // Stores all defined labels and their addresses.
-    std::map<std::string, Macro> macros;  // Stores all defined macros.
-    std::vector<bool> if_stack;         // Manages nested IF/ENDIF conditional blocks.
+    std::shared_ptr<const PreparedSource> source; // The source being assembled, with its macros.
+    std::map<std::string, uint16_t> defined_symbols; // Set with -D; they take precedence over EQU in the source.
+    std::string error_prefix;           // Names the variant in error messages.
+    std::map<std::string, ExpansionCacheEntry> expansion_cache; // Keyed by instruction set, macro name and normalized arguments.
+    std::vector<std::string>* xref_capture = nullptr; // Records referenced symbols while an expansion is cached.
+    std::vector<std::string> xref_captured;
+    std::vector<ExpansionFrame> expansion_stack; // Active macro and repeat-block expansions, innermost last.
+    std::string expansion_buffer;       // Reused buffer for spliced template lines.
+    uint64_t expanded_lines = 0;        // Lines produced by macro and repeat-block expansion in this pass.
+    uint64_t pass_bytes = 0;            // Bytes emitted in this pass, checked against the limits.
+    ExpansionLimits limits;
+    unsigned thread_count = 0;          // Worker threads for parallel stages; 0 = one per hardware thread.
+    bool macro_profiling = false;
+    std::map<std::string, MacroProfile> macro_profiles;
+    std::map<int, Macro> repeat_blocks;  // REPT/IRP/IRPC blocks in the source, compiled once and keyed by line.
+    std::set<std::string> redefinable_symbols; // Symbols defined with SET/DEFL.
+    std::map<std::string, Macro> library_macros;       // Macros preloaded from .mlb files.
+    std::map<std::string, uint16_t> library_equates;   // Equates preloaded from .mlb files.
+    std::set<std::string> constant_symbols; // EQU symbols whose value depends on no address.
+    bool constant_expression = true;    // Cleared when an expression uses '$' or a non-constant symbol.
+    std::vector<ConditionalBlock> if_stack; // Manages nested IF/ELSE/ENDIF conditional blocks.
+    std::vector<PassCheckpoint> checkpoints; // Left by pass 1 every CHECKPOINT_INTERVAL lines.
+    static const int CHECKPOINT_INTERVAL = 256;
+    bool throw_errors = false;          // Set in pass 2 workers and variant builds: errors throw the diagnostic instead of exiting.
+    size_t inactive_blocks = 0;         // Entries of if_stack whose branch is not active.
+    Cpu cpu = Cpu::I8080;               // Instruction set selected with .8080/.8085U/.Z80; every pass starts in 8080 mode.
+    std::vector<bool> wide_branches;    // Per relative branch, in pass order: widened to JP (DJNZ to DEC B/JP NZ).
+    size_t branch_ordinal = 0;          // Relative branches seen so far in this pass.
+    std::vector<BranchSite> branch_sites; // Short branches of the last pass 1, for relaxation.
+    static const int MAX_RELAXATION_ROUNDS = 16;
+    bool cross_reference = true;        // Whether references are recorded in cross_reference_data; off while relaxation evaluates targets.
     std::map<std::string, std::vector<int>> cross_reference_data; // Map of: {"symbol_name" -> vector of line numbers }
 
     // *** Parsed Tokens ***
@@ -47,22 +277,57 @@ private:
     std::string label, mnemonic, operand1, operand2, comment;
 
     // *** Mnemonic Dispatch ***
-    // A map to connect mnemonic strings (e.g., "mov") to their handler functions.
+    // A map to connect directive names (e.g., "db") to their handler functions.
     std::map<std::string, void (Assembler::*)()> mnemonic_handlers;
-    enum ImmediateType { IMMEDIATE8 = 8, IMMEDIATE16 = 16 };
 
     // --- Core Methods ---
     void initialize_mnemonic_handlers();
     void reset_state();
-    void preprocess_macros(const std::vector<std::string>& lines);
-    void do_pass(const std::vector<std::string>& lines);
+    void preprocess_macros(PreparedSource& prepared);
+    void run_pass();
+    template <class Policy> void do_pass(const std::vector<std::string>& lines);
+    template <class Policy> void run_lines(const std::vector<std::string>& lines, int first, int last);
+    void begin_assembly();
+    bool widen_branches();
+    template <class Policy> bool run_parallel_pass(const std::vector<std::string>& lines);
+    template <bool Octal> void write_listing_line(uint16_t line_address, size_t bytes_before, const std::string& line);
+    template <bool Octal> void list_skipped_lines(const std::vector<std::string>& lines, int first, int last);
     void expand_and_process_line(const std::string& line, int original_lineno);
-    void parse(std::string line);
+    void run_expansion(int original_lineno);
+    void process_line(const LineRecord& record);
+    bool next_expanded_line(LineRecord& record, int original_lineno);
+    void begin_iteration(ExpansionFrame& frame);
+    void finish_frame();
+    void push_frame(ExpansionFrame&& frame, int original_lineno);
+    void report_expansion_limit(const std::string& message, int original_lineno) const;
+    void account_profile(MacroProfile& profile, std::chrono::steady_clock::time_point started, uint64_t start_lines, size_t start_bytes);
+    void expand_cached_macro(const Macro& macro_def, const std::vector<std::string>& args, int original_lineno);
+    std::string expansion_cache_key(const Macro& macro_def, const std::vector<std::string>& args, Cpu line_cpu) const;
+    ExpansionCacheEntry expand_for_cache(const Macro& macro_def, const std::vector<std::string>& args) const;
+    void pre_expand_macros(PreparedSource& prepared);
+    bool is_replayable_line(const std::string& line) const;
+    Macro compile_repeat_block(const std::vector<std::string>& lines, size_t start, size_t end);
+    void start_repeat_block(const std::string& header, const Macro& block, int original_lineno, std::shared_ptr<const Macro> owner = nullptr);
+    void parse(const std::string& line);
+    LineSize size_line(const std::string& line, const std::map<std::string, Macro>& macros, Cpu line_cpu) const;
+    void size_lines(PreparedSource& prepared) const;
     void process_instruction();
+    void extract_output();
+    void map_output();
+    void unmap_output();
+    void use_own_image();
+    void extend_span(size_t size);
+    uint8_t& image_at(uint16_t at);
+    void record_line_span(uint16_t start, size_t count);
+    void sort_line_table();
     void report_error(const std::string& message, int line_num) const;
 
     // --- Pass Logic ---
-    void pass_action(int instruction_size, const std::vector<uint8_t>& output_bytes, bool should_add_label = true);
+    void pass_action(int instruction_size, bool should_add_label = true);
+    void store(const uint8_t* bytes, uint8_t fill, size_t count);
+    void emit(const uint8_t* bytes, size_t count);
+    void emit_byte(uint8_t value);
+    void emit_word(uint16_t value);
     void add_label();
 
     // --- Expression Evaluation Engine ---
@@ -74,29 +339,17 @@ private:
     bool evaluate_conditional(const std::string& expr);
     std::string get_token(std::string::const_iterator& it, std::string::const_iterator end);
     
-    // --- Instruction & Directive Handlers ---
-    void nop(); void lxi();  void stax(); void inx();  void inr();  void dcr();
-    void mvi(); void rlc();  void dad();  void ldax(); void dcx();  void rrc();
-    void ral(); void rar();  void shld(); void daa();  void lhld(); void cma();
-    void sta(); void stc();  void lda();  void cmc();  void mov();  void hlt();
-    void add(); void adc();  void sub();  void sbb();  void ana();  void xra();
-    void ora(); void cmp();  void rnz();  void pop();  void jnz();  void jmp();
-    void cnz(); void push(); void adi();  void rst();  void rz();   void ret();
-    void jz();  void cz();   void call(); void aci();  void rnc();  void jnc();
-    void i80_out(); void cnc();  void sui();  void rc();   void jc();   void i80_in();
-    void cc();  void sbi();  void jpe();  void rpo();  void jpo();  void xthl();
-    void cpo(); void ani();  void rpe();  void pchl(); void xchg(); void cpe();
-    void xri(); void rp();   void jp();   void di();   void cp();   void ori();
-    void rm();  void sphl(); void jm();   void ei();   void cm();   void cpi();
+    // --- Instruction Encoder & Directive Handlers ---
+    void encode_instruction(const InstructionSpec& spec);
+    void encode_z80(InstructionRange forms);
+    void encode_relative_branch(const InstructionSpec& spec, const std::string& target, int condition);
     void db();  void ds();   void dw();   void end();  void equ();  void name();
-    void org(); void title();
-    void sim(); void rim();
+    void org(); void title(); void set(); void select_cpu();
 
     // --- Helper Methods ---
     void check_operands(bool valid, const std::string& mnemonic_name);
     int register_offset8(std::string raw_register);
-    int register_offset16();
-    void immediate_operand(ImmediateType operand_type = IMMEDIATE8);
+    int register_field(OperandClass operand_class, std::string op);
     void address16(const std::string& operand);
     int get_number(std::string input) const;
     bool should_skip() const;
@@ -0,0 +1,341 @@
+#ifndef INSTRUCTIONS_H
+#define INSTRUCTIONS_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <algorithm>
+#include <iterator>
+
+// What an instruction operand may be, and how it is encoded.
+enum class OperandClass : uint8_t {
+    NONE,       // No operand.
+    REG8,       // B, C, D, E, H, L, M or A: a 3-bit field.
+    PAIR,       // B, D, H or SP: a 2-bit field.
+    PAIR_PSW,   // B, D, H or PSW (PUSH/POP): a 2-bit field.
+    PAIR_BD,    // B or D (LDAX/STAX): a 1-bit field.
+    RST,        // Restart vector 0-7: a 3-bit field.
+    IMM8,       // Expression, one byte after the opcode.
+    IMM16,      // Expression or address, two bytes after the opcode (low byte first).
+
+    // Z80 operands (Zilog syntax). HL forms also take IX/IY, which adds a DD/FD prefix.
+    Z_A,        // A.
+    Z_R8,       // B, C, D, E, H, L, (HL), A or (IX+d)/(IY+d): a 3-bit field.
+    Z_RP,       // BC, DE, HL or SP: a 2-bit field.
+    Z_RP_AF,    // BC, DE, HL or AF (PUSH/POP): a 2-bit field.
+    Z_HL,       // HL only.
+    Z_HLX,      // HL, IX or IY.
+    Z_DE, Z_SP, Z_AF, Z_AF_ALT, Z_I, Z_R, // DE, SP, AF, AF', I, R.
+    Z_IND_BC, Z_IND_DE, Z_IND_SP, Z_IND_C, // (BC), (DE), (SP), (C).
+    Z_IND_HL,   // (HL), (IX) or (IY), for JP.
+    Z_IND_NN,   // (address): two bytes after the opcode.
+    Z_IND_N,    // (port): one byte after the opcode.
+    Z_CC,       // NZ, Z, NC, C, PO, PE, P or M: a 3-bit field.
+    Z_CC_JR,    // NZ, Z, NC or C: a 2-bit field.
+    Z_BIT,      // Bit number 0-7: a 3-bit field.
+    Z_RST,      // Restart address 00h-38h, added to the opcode.
+    Z_IM,       // Interrupt mode 0-2.
+    Z_REL       // Branch target, a displacement byte after the opcode.
+};
+
+// The instruction set the assembler is encoding for, switched with .8080, .8085U and .Z80.
+// I8085U is the 8080/8085 set plus the 8085's undocumented instructions.
+enum class Cpu : uint8_t { I8080, I8085U, Z80 };
+
+// Whether a lowercase word is one of the directives selecting an instruction set.
+inline bool is_cpu_directive(const std::string& word) { return word == ".8080" || word == ".8085u" || word == ".z80"; }
+
+// The instruction set a .8080/.8085U/.Z80 directive selects.
+inline Cpu cpu_from_directive(const std::string& word) { return word == ".z80" ? Cpu::Z80 : word == ".8085u" ? Cpu::I8085U : Cpu::I8080; }
+
+// One instruction form. Register-class operands are shifted into the base opcode,
+// immediate operands follow it. T-states are those of the 8085 (or Z80); `states_alt` is the count
+// with M/(HL) as the register operand, or for a conditional branch that is taken (0 if it never differs).
+struct InstructionSpec {
+    const char* mnemonic;
+    OperandClass operand1, operand2;
+    uint8_t opcode;
+    uint8_t shift1, shift2;             // Bit position of the operand1/operand2 register field.
+    uint8_t size;                       // Bytes, opcode and CB/ED prefix included (not IX/IY prefix or displacement).
+    uint8_t states, states_alt;
+    uint8_t prefix = 0;                 // Z80 CB or ED prefix byte, 0 if none.
+};
+
+using OC = OperandClass;
+
+// The instruction set, sorted by mnemonic so lookups are a binary search over one small array.
+inline constexpr InstructionSpec INSTRUCTION_SET[] = {
+    { "aci",  OC::IMM8,     OC::NONE,  0xCE, 0, 0, 2,  7,  0 },
+    { "adc",  OC::REG8,     OC::NONE,  0x88, 0, 0, 1,  4,  7 },
+    { "add",  OC::REG8,     OC::NONE,  0x80, 0, 0, 1,  4,  7 },
+    { "adi",  OC::IMM8,     OC::NONE,  0xC6, 0, 0, 2,  7,  0 },
+    { "ana",  OC::REG8,     OC::NONE,  0xA0, 0, 0, 1,  4,  7 },
+    { "ani",  OC::IMM8,     OC::NONE,  0xE6, 0, 0, 2,  7,  0 },
+    { "call", OC::IMM16,    OC::NONE,  0xCD, 0, 0, 3, 18,  0 },
+    { "cc",   OC::IMM16,    OC::NONE,  0xDC, 0, 0, 3,  9, 18 },
+    { "cm",   OC::IMM16,    OC::NONE,  0xFC, 0, 0, 3,  9, 18 },
+    { "cma",  OC::NONE,     OC::NONE,  0x2F, 0, 0, 1,  4,  0 },
+    { "cmc",  OC::NONE,     OC::NONE,  0x3F, 0, 0, 1,  4,  0 },
+    { "cmp",  OC::REG8,     OC::NONE,  0xB8, 0, 0, 1,  4,  7 },
+    { "cnc",  OC::IMM16,    OC::NONE,  0xD4, 0, 0, 3,  9, 18 },
+    { "cnz",  OC::IMM16,    OC::NONE,  0xC4, 0, 0, 3,  9, 18 },
+    { "cp",   OC::IMM16,    OC::NONE,  0xF4, 0, 0, 3,  9, 18 },
+    { "cpe",  OC::IMM16,    OC::NONE,  0xEC, 0, 0, 3,  9, 18 },
+    { "cpi",  OC::IMM8,     OC::NONE,  0xFE, 0, 0, 2,  7,  0 },
+    { "cpo",  OC::IMM16,    OC::NONE,  0xE4, 0, 0, 3,  9, 18 },
+    { "cz",   OC::IMM16,    OC::NONE,  0xCC, 0, 0, 3,  9, 18 },
+    { "daa",  OC::NONE,     OC::NONE,  0x27, 0, 0, 1,  4,  0 },
+    { "dad",  OC::PAIR,     OC::NONE,  0x09, 4, 0, 1, 10,  0 },
+    { "dcr",  OC::REG8,     OC::NONE,  0x05, 3, 0, 1,  4, 10 },
+    { "dcx",  OC::PAIR,     OC::NONE,  0x0B, 4, 0, 1,  6,  0 },
+    { "di",   OC::NONE,     OC::NONE,  0xF3, 0, 0, 1,  4,  0 },
+    { "ei",   OC::NONE,     OC::NONE,  0xFB, 0, 0, 1,  4,  0 },
+    { "hlt",  OC::NONE,     OC::NONE,  0x76, 0, 0, 1,  5,  0 },
+    { "in",   OC::IMM8,     OC::NONE,  0xDB, 0, 0, 2, 10,  0 },
+    { "inr",  OC::REG8,     OC::NONE,  0x04, 3, 0, 1,  4, 10 },
+    { "inx",  OC::PAIR,     OC::NONE,  0x03, 4, 0, 1,  6,  0 },
+    { "jc",   OC::IMM16,    OC::NONE,  0xDA, 0, 0, 3,  7, 10 },
+    { "jm",   OC::IMM16,    OC::NONE,  0xFA, 0, 0, 3,  7, 10 },
+    { "jmp",  OC::IMM16,    OC::NONE,  0xC3, 0, 0, 3, 10,  0 },
+    { "jnc",  OC::IMM16,    OC::NONE,  0xD2, 0, 0, 3,  7, 10 },
+    { "jnz",  OC::IMM16,    OC::NONE,  0xC2, 0, 0, 3,  7, 10 },
+    { "jp",   OC::IMM16,    OC::NONE,  0xF2, 0, 0, 3,  7, 10 },
+    { "jpe",  OC::IMM16,    OC::NONE,  0xEA, 0, 0, 3,  7, 10 },
+    { "jpo",  OC::IMM16,    OC::NONE,  0xE2, 0, 0, 3,  7, 10 },
+    { "jz",   OC::IMM16,    OC::NONE,  0xCA, 0, 0, 3,  7, 10 },
+    { "lda",  OC::IMM16,    OC::NONE,  0x3A, 0, 0, 3, 13,  0 },
+    { "ldax", OC::PAIR_BD,  OC::NONE,  0x0A, 4, 0, 1,  7,  0 },
+    { "lhld", OC::IMM16,    OC::NONE,  0x2A, 0, 0, 3, 16,  0 },
+    { "lxi",  OC::PAIR,     OC::IMM16, 0x01, 4, 0, 3, 10,  0 },
+    { "mov",  OC::REG8,     OC::REG8,  0x40, 3, 0, 1,  4,  7 },
+    { "mvi",  OC::REG8,     OC::IMM8,  0x06, 3, 0, 2,  7, 10 },
+    { "nop",  OC::NONE,     OC::NONE,  0x00, 0, 0, 1,  4,  0 },
+    { "ora",  OC::REG8,     OC::NONE,  0xB0, 0, 0, 1,  4,  7 },
+    { "ori",  OC::IMM8,     OC::NONE,  0xF6, 0, 0, 2,  7,  0 },
+    { "out",  OC::IMM8,     OC::NONE,  0xD3, 0, 0, 2, 10,  0 },
+    { "pchl", OC::NONE,     OC::NONE,  0xE9, 0, 0, 1,  6,  0 },
+    { "pop",  OC::PAIR_PSW, OC::NONE,  0xC1, 4, 0, 1, 10,  0 },
+    { "push", OC::PAIR_PSW, OC::NONE,  0xC5, 4, 0, 1, 12,  0 },
+    { "ral",  OC::NONE,     OC::NONE,  0x17, 0, 0, 1,  4,  0 },
+    { "rar",  OC::NONE,     OC::NONE,  0x1F, 0, 0, 1,  4,  0 },
+    { "rc",   OC::NONE,     OC::NONE,  0xD8, 0, 0, 1,  6, 12 },
+    { "ret",  OC::NONE,     OC::NONE,  0xC9, 0, 0, 1, 10,  0 },
+    { "rim",  OC::NONE,     OC::NONE,  0x20, 0, 0, 1,  4,  0 },
+    { "rlc",  OC::NONE,     OC::NONE,  0x07, 0, 0, 1,  4,  0 },
+    { "rm",   OC::NONE,     OC::NONE,  0xF8, 0, 0, 1,  6, 12 },
+    { "rnc",  OC::NONE,     OC::NONE,  0xD0, 0, 0, 1,  6, 12 },
+    { "rnz",  OC::NONE,     OC::NONE,  0xC0, 0, 0, 1,  6, 12 },
+    { "rp",   OC::NONE,     OC::NONE,  0xF0, 0, 0, 1,  6, 12 },
+    { "rpe",  OC::NONE,     OC::NONE,  0xE8, 0, 0, 1,  6, 12 },
+    { "rpo",  OC::NONE,     OC::NONE,  0xE0, 0, 0, 1,  6, 12 },
+    { "rrc",  OC::NONE,     OC::NONE,  0x0F, 0, 0, 1,  4,  0 },
+    { "rst",  OC::RST,      OC::NONE,  0xC7, 3, 0, 1, 12,  0 },
+    { "rz",   OC::NONE,     OC::NONE,  0xC8, 0, 0, 1,  6, 12 },
+    { "sbb",  OC::REG8,     OC::NONE,  0x98, 0, 0, 1,  4,  7 },
+    { "sbi",  OC::IMM8,     OC::NONE,  0xDE, 0, 0, 2,  7,  0 },
+    { "shld", OC::IMM16,    OC::NONE,  0x22, 0, 0, 3, 16,  0 },
+    { "sim",  OC::NONE,     OC::NONE,  0x30, 0, 0, 1,  4,  0 },
+    { "sphl", OC::NONE,     OC::NONE,  0xF9, 0, 0, 1,  6,  0 },
+    { "sta",  OC::IMM16,    OC::NONE,  0x32, 0, 0, 3, 13,  0 },
+    { "stax", OC::PAIR_BD,  OC::NONE,  0x02, 4, 0, 1,  7,  0 },
+    { "stc",  OC::NONE,     OC::NONE,  0x37, 0, 0, 1,  4,  0 },
+    { "sub",  OC::REG8,     OC::NONE,  0x90, 0, 0, 1,  4,  7 },
+    { "sui",  OC::IMM8,     OC::NONE,  0xD6, 0, 0, 2,  7,  0 },
+    { "xchg", OC::NONE,     OC::NONE,  0xEB, 0, 0, 1,  4,  0 },
+    { "xra",  OC::REG8,     OC::NONE,  0xA8, 0, 0, 1,  4,  7 },
+    { "xri",  OC::IMM8,     OC::NONE,  0xEE, 0, 0, 2,  7,  0 },
+    { "xthl", OC::NONE,     OC::NONE,  0xE3, 0, 0, 1, 16,  0 },
+};
+
+// The undocumented 8085 instructions, available after .8085U on top of INSTRUCTION_SET. JNX5/JX5
+// are the Intel-style names of JNK/JK (jump on the K flag, bit 5 of the flags).
+inline constexpr InstructionSpec UNDOCUMENTED_8085_SET[] = {
+    { "arhl", OC::NONE,     OC::NONE,  0x10, 0, 0, 1,  7,  0 },
+    { "dsub", OC::NONE,     OC::NONE,  0x08, 0, 0, 1, 10,  0 },
+    { "jk",   OC::IMM16,    OC::NONE,  0xFD, 0, 0, 3,  7, 10 },
+    { "jnk",  OC::IMM16,    OC::NONE,  0xDD, 0, 0, 3,  7, 10 },
+    { "jnx5", OC::IMM16,    OC::NONE,  0xDD, 0, 0, 3,  7, 10 },
+    { "jx5",  OC::IMM16,    OC::NONE,  0xFD, 0, 0, 3,  7, 10 },
+    { "ldhi", OC::IMM8,     OC::NONE,  0x28, 0, 0, 2, 10,  0 },
+    { "ldsi", OC::IMM8,     OC::NONE,  0x38, 0, 0, 2, 10,  0 },
+    { "lhlx", OC::NONE,     OC::NONE,  0xED, 0, 0, 1, 10,  0 },
+    { "rdel", OC::NONE,     OC::NONE,  0x18, 0, 0, 1, 10,  0 },
+    { "rstv", OC::NONE,     OC::NONE,  0xCB, 0, 0, 1,  6, 12 },
+    { "shlx", OC::NONE,     OC::NONE,  0xD9, 0, 0, 1, 10,  0 },
+};
+
+// The Z80 instruction set. A mnemonic can have several forms; they are tried in table order,
+// so more specific operands (A, (BC), HL) come before the general ones they overlap with.
+inline constexpr InstructionSpec Z80_INSTRUCTION_SET[] = {
+    { "adc",  OC::Z_A,      OC::Z_R8,     0x88, 0, 0, 1,  4,  7 },
+    { "adc",  OC::Z_A,      OC::IMM8,     0xCE, 0, 0, 2,  7,  0 },
+    { "adc",  OC::Z_HL,     OC::Z_RP,     0x4A, 0, 4, 2, 15,  0, 0xED },
+    { "adc",  OC::Z_R8,     OC::NONE,     0x88, 0, 0, 1,  4,  7 },
+    { "adc",  OC::IMM8,     OC::NONE,     0xCE, 0, 0, 2,  7,  0 },
+    { "add",  OC::Z_A,      OC::Z_R8,     0x80, 0, 0, 1,  4,  7 },
+    { "add",  OC::Z_A,      OC::IMM8,     0xC6, 0, 0, 2,  7,  0 },
+    { "add",  OC::Z_HLX,    OC::Z_RP,     0x09, 0, 4, 1, 11,  0 },
+    { "add",  OC::Z_R8,     OC::NONE,     0x80, 0, 0, 1,  4,  7 },
+    { "add",  OC::IMM8,     OC::NONE,     0xC6, 0, 0, 2,  7,  0 },
+    { "and",  OC::Z_R8,     OC::NONE,     0xA0, 0, 0, 1,  4,  7 },
+    { "and",  OC::IMM8,     OC::NONE,     0xE6, 0, 0, 2,  7,  0 },
+    { "and",  OC::Z_A,      OC::Z_R8,     0xA0, 0, 0, 1,  4,  7 },
+    { "and",  OC::Z_A,      OC::IMM8,     0xE6, 0, 0, 2,  7,  0 },
+    { "bit",  OC::Z_BIT,    OC::Z_R8,     0x40, 3, 0, 2,  8, 12, 0xCB },
+    { "call", OC::IMM16,    OC::NONE,     0xCD, 0, 0, 3, 17,  0 },
+    { "call", OC::Z_CC,     OC::IMM16,    0xC4, 3, 0, 3, 10, 17 },
+    { "ccf",  OC::NONE,     OC::NONE,     0x3F, 0, 0, 1,  4,  0 },
+    { "cp",   OC::Z_R8,     OC::NONE,     0xB8, 0, 0, 1,  4,  7 },
+    { "cp",   OC::IMM8,     OC::NONE,     0xFE, 0, 0, 2,  7,  0 },
+    { "cp",   OC::Z_A,      OC::Z_R8,     0xB8, 0, 0, 1,  4,  7 },
+    { "cp",   OC::Z_A,      OC::IMM8,     0xFE, 0, 0, 2,  7,  0 },
+    { "cpd",  OC::NONE,     OC::NONE,     0xA9, 0, 0, 2, 16,  0, 0xED },
+    { "cpdr", OC::NONE,     OC::NONE,     0xB9, 0, 0, 2, 16, 21, 0xED },
+    { "cpi",  OC::NONE,     OC::NONE,     0xA1, 0, 0, 2, 16,  0, 0xED },
+    { "cpir", OC::NONE,     OC::NONE,     0xB1, 0, 0, 2, 16, 21, 0xED },
+    { "cpl",  OC::NONE,     OC::NONE,     0x2F, 0, 0, 1,  4,  0 },
+    { "daa",  OC::NONE,     OC::NONE,     0x27, 0, 0, 1,  4,  0 },
+    { "dec",  OC::Z_R8,     OC::NONE,     0x05, 3, 0, 1,  4, 11 },
+    { "dec",  OC::Z_RP,     OC::NONE,     0x0B, 4, 0, 1,  6,  0 },
+    { "di",   OC::NONE,     OC::NONE,     0xF3, 0, 0, 1,  4,  0 },
+    { "djnz", OC::Z_REL,    OC::NONE,     0x10, 0, 0, 2,  8, 13 },
+    { "ei",   OC::NONE,     OC::NONE,     0xFB, 0, 0, 1,  4,  0 },
+    { "ex",   OC::Z_AF,     OC::Z_AF_ALT, 0x08, 0, 0, 1,  4,  0 },
+    { "ex",   OC::Z_DE,     OC::Z_HL,     0xEB, 0, 0, 1,  4,  0 },
+    { "ex",   OC::Z_IND_SP, OC::Z_HLX,    0xE3, 0, 0, 1, 19,  0 },
+    { "exx",  OC::NONE,     OC::NONE,     0xD9, 0, 0, 1,  4,  0 },
+    { "halt", OC::NONE,     OC::NONE,     0x76, 0, 0, 1,  4,  0 },
+    { "im",   OC::Z_IM,     OC::NONE,     0x46, 0, 0, 2,  8,  0, 0xED },
+    { "in",   OC::Z_A,      OC::Z_IND_N,  0xDB, 0, 0, 2, 11,  0 },
+    { "in",   OC::Z_R8,     OC::Z_IND_C,  0x40, 3, 0, 2, 12,  0, 0xED },
+    { "inc",  OC::Z_R8,     OC::NONE,     0x04, 3, 0, 1,  4, 11 },
+    { "inc",  OC::Z_RP,     OC::NONE,     0x03, 4, 0, 1,  6,  0 },
+    { "ind",  OC::NONE,     OC::NONE,     0xAA, 0, 0, 2, 16,  0, 0xED },
+    { "indr", OC::NONE,     OC::NONE,     0xBA, 0, 0, 2, 16, 21, 0xED },
+    { "ini",  OC::NONE,     OC::NONE,     0xA2, 0, 0, 2, 16,  0, 0xED },
+    { "inir", OC::NONE,     OC::NONE,     0xB2, 0, 0, 2, 16, 21, 0xED },
+    { "jp",   OC::IMM16,    OC::NONE,     0xC3, 0, 0, 3, 10,  0 },
+    { "jp",   OC::Z_IND_HL, OC::NONE,     0xE9, 0, 0, 1,  4,  0 },
+    { "jp",   OC::Z_CC,     OC::IMM16,    0xC2, 3, 0, 3, 10,  0 },
+    { "jr",   OC::Z_REL,    OC::NONE,     0x18, 0, 0, 2, 12,  0 },
+    { "jr",   OC::Z_CC_JR,  OC::Z_REL,    0x20, 3, 0, 2,  7, 12 },
+    { "ld",   OC::Z_A,      OC::Z_IND_BC, 0x0A, 0, 0, 1,  7,  0 },
+    { "ld",   OC::Z_A,      OC::Z_IND_DE, 0x1A, 0, 0, 1,  7,  0 },
+    { "ld",   OC::Z_A,      OC::Z_IND_NN, 0x3A, 0, 0, 3, 13,  0 },
+    { "ld",   OC::Z_A,      OC::Z_I,      0x57, 0, 0, 2,  9,  0, 0xED },
+    { "ld",   OC::Z_A,      OC::Z_R,      0x5F, 0, 0, 2,  9,  0, 0xED },
+    { "ld",   OC::Z_IND_BC, OC::Z_A,      0x02, 0, 0, 1,  7,  0 },
+    { "ld",   OC::Z_IND_DE, OC::Z_A,      0x12, 0, 0, 1,  7,  0 },
+    { "ld",   OC::Z_IND_NN, OC::Z_A,      0x32, 0, 0, 3, 13,  0 },
+    { "ld",   OC::Z_I,      OC::Z_A,      0x47, 0, 0, 2,  9,  0, 0xED },
+    { "ld",   OC::Z_R,      OC::Z_A,      0x4F, 0, 0, 2,  9,  0, 0xED },
+    { "ld",   OC::Z_R8,     OC::Z_R8,     0x40, 3, 0, 1,  4,  7 },
+    { "ld",   OC::Z_R8,     OC::IMM8,     0x06, 3, 0, 2,  7, 10 },
+    { "ld",   OC::Z_HLX,    OC::Z_IND_NN, 0x2A, 0, 0, 3, 16,  0 },
+    { "ld",   OC::Z_RP,     OC::Z_IND_NN, 0x4B, 4, 0, 4, 20,  0, 0xED },
+    { "ld",   OC::Z_RP,     OC::IMM16,    0x01, 4, 0, 3, 10,  0 },
+    { "ld",   OC::Z_IND_NN, OC::Z_HLX,    0x22, 0, 0, 3, 16,  0 },
+    { "ld",   OC::Z_IND_NN, OC::Z_RP,     0x43, 0, 4, 4, 20,  0, 0xED },
+    { "ld",   OC::Z_SP,     OC::Z_HLX,    0xF9, 0, 0, 1,  6,  0 },
+    { "ldd",  OC::NONE,     OC::NONE,     0xA8, 0, 0, 2, 16,  0, 0xED },
+    { "lddr", OC::NONE,     OC::NONE,     0xB8, 0, 0, 2, 16, 21, 0xED },
+    { "ldi",  OC::NONE,     OC::NONE,     0xA0, 0, 0, 2, 16,  0, 0xED },
+    { "ldir", OC::NONE,     OC::NONE,     0xB0, 0, 0, 2, 16, 21, 0xED },
+    { "neg",  OC::NONE,     OC::NONE,     0x44, 0, 0, 2,  8,  0, 0xED },
+    { "nop",  OC::NONE,     OC::NONE,     0x00, 0, 0, 1,  4,  0 },
+    { "or",   OC::Z_R8,     OC::NONE,     0xB0, 0, 0, 1,  4,  7 },
+    { "or",   OC::IMM8,     OC::NONE,     0xF6, 0, 0, 2,  7,  0 },
+    { "or",   OC::Z_A,      OC::Z_R8,     0xB0, 0, 0, 1,  4,  7 },
+    { "or",   OC::Z_A,      OC::IMM8,     0xF6, 0, 0, 2,  7,  0 },
+    { "otdr", OC::NONE,     OC::NONE,     0xBB, 0, 0, 2, 16, 21, 0xED },
+    { "otir", OC::NONE,     OC::NONE,     0xB3, 0, 0, 2, 16, 21, 0xED },
+    { "out",  OC::Z_IND_N,  OC::Z_A,      0xD3, 0, 0, 2, 11,  0 },
+    { "out",  OC::Z_IND_C,  OC::Z_R8,     0x41, 0, 3, 2, 12,  0, 0xED },
+    { "outd", OC::NONE,     OC::NONE,     0xAB, 0, 0, 2, 16,  0, 0xED },
+    { "outi", OC::NONE,     OC::NONE,     0xA3, 0, 0, 2, 16,  0, 0xED },
+    { "pop",  OC::Z_RP_AF,  OC::NONE,     0xC1, 4, 0, 1, 10,  0 },
+    { "push", OC::Z_RP_AF,  OC::NONE,     0xC5, 4, 0, 1, 11,  0 },
+    { "res",  OC::Z_BIT,    OC::Z_R8,     0x80, 3, 0, 2,  8, 15, 0xCB },
+    { "ret",  OC::NONE,     OC::NONE,     0xC9, 0, 0, 1, 10,  0 },
+    { "ret",  OC::Z_CC,     OC::NONE,     0xC0, 3, 0, 1,  5, 11 },
+    { "reti", OC::NONE,     OC::NONE,     0x4D, 0, 0, 2, 14,  0, 0xED },
+    { "retn", OC::NONE,     OC::NONE,     0x45, 0, 0, 2, 14,  0, 0xED },
+    { "rl",   OC::Z_R8,     OC::NONE,     0x10, 0, 0, 2,  8, 15, 0xCB },
+    { "rla",  OC::NONE,     OC::NONE,     0x17, 0, 0, 1,  4,  0 },
+    { "rlc",  OC::Z_R8,     OC::NONE,     0x00, 0, 0, 2,  8, 15, 0xCB },
+    { "rlca", OC::NONE,     OC::NONE,     0x07, 0, 0, 1,  4,  0 },
+    { "rld",  OC::NONE,     OC::NONE,     0x6F, 0, 0, 2, 18,  0, 0xED },
+    { "rr",   OC::Z_R8,     OC::NONE,     0x18, 0, 0, 2,  8, 15, 0xCB },
+    { "rra",  OC::NONE,     OC::NONE,     0x1F, 0, 0, 1,  4,  0 },
+    { "rrc",  OC::Z_R8,     OC::NONE,     0x08, 0, 0, 2,  8, 15, 0xCB },
+    { "rrca", OC::NONE,     OC::NONE,     0x0F, 0, 0, 1,  4,  0 },
+    { "rrd",  OC::NONE,     OC::NONE,     0x67, 0, 0, 2, 18,  0, 0xED },
+    { "rst",  OC::Z_RST,    OC::NONE,     0xC7, 0, 0, 1, 11,  0 },
+    { "sbc",  OC::Z_A,      OC::Z_R8,     0x98, 0, 0, 1,  4,  7 },
+    { "sbc",  OC::Z_A,      OC::IMM8,     0xDE, 0, 0, 2,  7,  0 },
+    { "sbc",  OC::Z_HL,     OC::Z_RP,     0x42, 0, 4, 2, 15,  0, 0xED },
+    { "sbc",  OC::Z_R8,     OC::NONE,     0x98, 0, 0, 1,  4,  7 },
+    { "sbc",  OC::IMM8,     OC::NONE,     0xDE, 0, 0, 2,  7,  0 },
+    { "scf",  OC::NONE,     OC::NONE,     0x37, 0, 0, 1,  4,  0 },
+    { "set",  OC::Z_BIT,    OC::Z_R8,     0xC0, 3, 0, 2,  8, 15, 0xCB },
+    { "sla",  OC::Z_R8,     OC::NONE,     0x20, 0, 0, 2,  8, 15, 0xCB },
+    { "sll",  OC::Z_R8,     OC::NONE,     0x30, 0, 0, 2,  8, 15, 0xCB },
+    { "sra",  OC::Z_R8,     OC::NONE,     0x28, 0, 0, 2,  8, 15, 0xCB },
+    { "srl",  OC::Z_R8,     OC::NONE,     0x38, 0, 0, 2,  8, 15, 0xCB },
+    { "sub",  OC::Z_R8,     OC::NONE,     0x90, 0, 0, 1,  4,  7 },
+    { "sub",  OC::IMM8,     OC::NONE,     0xD6, 0, 0, 2,  7,  0 },
+    { "sub",  OC::Z_A,      OC::Z_R8,     0x90, 0, 0, 1,  4,  7 },
+    { "sub",  OC::Z_A,      OC::IMM8,     0xD6, 0, 0, 2,  7,  0 },
+    { "xor",  OC::Z_R8,     OC::NONE,     0xA8, 0, 0, 1,  4,  7 },
+    { "xor",  OC::IMM8,     OC::NONE,     0xEE, 0, 0, 2,  7,  0 },
+    { "xor",  OC::Z_A,      OC::Z_R8,     0xA8, 0, 0, 1,  4,  7 },
+    { "xor",  OC::Z_A,      OC::IMM8,     0xEE, 0, 0, 2,  7,  0 },
+};
+
+// Checked at compile time: the binary search below relies on the order. Only the Z80 table
+// repeats a mnemonic, once per form.
+template <size_t N>
+constexpr bool instruction_set_sorted(const InstructionSpec (&table)[N], bool repeats) {
+    for (size_t i = 1; i < N; ++i) {
+        const char* a = table[i - 1].mnemonic;
+        const char* b = table[i].mnemonic;
+        while (*a && *a == *b) { ++a; ++b; }
+        unsigned char x = static_cast<unsigned char>(*a), y = static_cast<unsigned char>(*b);
+        if (x > y || (x == y && !repeats)) return false;
+    }
+    return true;
+}
+static_assert(instruction_set_sorted(INSTRUCTION_SET, false), "INSTRUCTION_SET must be sorted by mnemonic");
+static_assert(instruction_set_sorted(UNDOCUMENTED_8085_SET, false), "UNDOCUMENTED_8085_SET must be sorted by mnemonic");
+static_assert(instruction_set_sorted(Z80_INSTRUCTION_SET, true), "Z80_INSTRUCTION_SET must be sorted by mnemonic");
+
+// The forms of one mnemonic in a table: [first, last).
+struct InstructionRange {
+    const InstructionSpec* first;
+    const InstructionSpec* last;
+    bool empty() const { return first == last; }
+};
+
+// Lets the lookup compare table entries and names in either order.
+inline const char* mnemonic_of(const InstructionSpec& spec) { return spec.mnemonic; }
+inline const char* mnemonic_of(const std::string& name) { return name.c_str(); }
+
+// Finds the forms of a lowercase mnemonic in one table.
+template <size_t N>
+InstructionRange find_in_table(const InstructionSpec (&table)[N], const std::string& mnemonic) {
+    auto found = std::equal_range(std::begin(table), std::end(table), mnemonic, [](const auto& a, const auto& b) { return std::strcmp(mnemonic_of(a), mnemonic_of(b)) < 0; });
+    return { found.first, found.second };
+}
+
+// Finds the forms of a lowercase mnemonic in the instruction set of `cpu`. The range is empty
+// for directives and unknown words.
+inline InstructionRange find_instructions(Cpu cpu, const std::string& mnemonic) {
+    if (cpu == Cpu::Z80) return find_in_table(Z80_INSTRUCTION_SET, mnemonic);
+    if (cpu == Cpu::I8085U) {
+        InstructionRange found = find_in_table(UNDOCUMENTED_8085_SET, mnemonic);
+        if (!found.empty()) return found;
+    }
+    return find_in_table(INSTRUCTION_SET, mnemonic);
+}
+
+#endif // INSTRUCTIONS_H
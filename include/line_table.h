@@ -0,0 +1,46 @@
+#ifndef LINE_TABLE_H
+#define LINE_TABLE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// One run of the debug line table (-g): addresses address..last were emitted by source line
+// `line` (1-based) of file `file`, at macro expansion depth `depth` (0 = the source line itself).
+struct LineTableEntry {
+    uint16_t address;
+    uint16_t last;
+    uint32_t line;
+    uint16_t file;
+    uint16_t depth;
+};
+
+// Renders a .dbg file. All numbers are little-endian:
+//   "AYDB", u16 version (1), u16 file count, u32 entry count
+//   per file: u16 name length, name
+//   per entry, by address: u16 address, u16 last, u32 line, u16 file, u16 depth
+//   per entry, by file, line and address: u32 index of the entry
+// `entries` must be sorted by address and must not overlap.
+std::string format_line_table(const std::vector<std::string>& files, const std::vector<LineTableEntry>& entries);
+
+// A loaded .dbg file. Both lookups are binary searches over the tables stored in the file.
+class LineTable {
+public:
+    bool load(const std::string& filename, std::string& error);
+    bool parse(const std::string& data, std::string& error);
+
+    // The entry covering an address, or null if no line emitted it.
+    const LineTableEntry* find_address(uint16_t address) const;
+    // Every run of addresses emitted by a line, in address order.
+    std::vector<const LineTableEntry*> find_line(uint16_t file, uint32_t line) const;
+
+    const std::vector<std::string>& files() const { return file_names; }
+    const std::vector<LineTableEntry>& entries() const { return by_address; }
+
+private:
+    std::vector<std::string> file_names;
+    std::vector<LineTableEntry> by_address;
+    std::vector<uint32_t> by_line;      // Indices into by_address, ordered by file, line and address.
+};
+
+#endif // LINE_TABLE_H
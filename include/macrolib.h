@@ -0,0 +1,27 @@
+#ifndef MACROLIB_H
+#define MACROLIB_H
+
+#include <map>
+#include <string>
+#include <cstdint>
+#include "Assembler.h"
+
+// A precompiled macro/equate library (.mlb file). Holds compiled macro templates
+// and the equates whose values are constants, so a program can use them without
+// the library source being tokenized again.
+struct MacroLibrary {
+    std::map<std::string, Macro> macros;
+    std::map<std::string, uint16_t> equates;
+};
+
+// Version of the .mlb format. Files with another version are rejected.
+const uint16_t MACRO_LIBRARY_VERSION = 1;
+
+// Writes a library to disk. Returns false if the file cannot be written.
+bool write_macro_library(const std::string& filename, const MacroLibrary& library);
+
+// Maps a library file into memory and decodes it into `library`, merging with
+// anything already there. On failure returns false and describes the problem in `error`.
+bool load_macro_library(const std::string& filename, MacroLibrary& library, std::string& error);
+
+#endif // MACROLIB_H
@@ -0,0 +1,71 @@
+#ifndef OUTPUT_WRITERS_H
+#define OUTPUT_WRITERS_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "Assembler.h"
+
+// File formats the assembled program can be written in (-f). SELF_EXTRACTING is a .com that
+// unpacks the program (see packer.h); it is built by the caller, not by format_program.
+enum class OutputFormat { BINARY, INTEL_HEX, SREC, SELF_EXTRACTING };
+
+// Parses a -f argument: "bin", "ihex", "srec" or "sfx". Returns false for anything else.
+bool parse_output_format(const std::string& name, OutputFormat& format);
+
+// The conventional extension of a format's files, dot included.
+const char* output_extension(OutputFormat format);
+
+// Renders the written address ranges as Intel HEX: 16-byte data records, then the end-of-file
+// record. `output` starts at `origin`; addresses outside the ranges produce no records.
+std::string format_intel_hex(const std::vector<uint8_t>& output, uint16_t origin, const std::vector<AddressRange>& ranges);
+
+// Renders the written address ranges as Motorola S-records: an S0 header, 16-byte S1 data
+// records, an S5 record count and the S9 terminator.
+std::string format_srec(const std::vector<uint8_t>& output, uint16_t origin, const std::vector<AddressRange>& ranges);
+
+// The program of a finished assembly, in the given format, ready to be written in one go.
+std::string format_program(const Assembler& assembler, OutputFormat format);
+
+// A run of bytes that differ between two flat images, as an offset into the new image.
+struct PatchRange {
+    uint32_t offset;
+    uint32_t size;
+};
+
+// Finds the ranges of `image` that differ from `base` (bytes past the end of `base` always
+// differ). Without a sector size, runs closer than the cost of a patch record are merged;
+// with one, every sector holding a change is patched whole, sectors being aligned on the
+// addresses, where image[0] is at `origin`.
+std::vector<PatchRange> diff_images(const std::vector<uint8_t>& base, const std::vector<uint8_t>& image, uint16_t origin, uint32_t sector);
+
+// Renders the ranges as an IPS patch that turns `base` into `image`. If `image` is shorter,
+// the patch ends with the truncation size.
+std::string format_ips(const std::vector<uint8_t>& base, const std::vector<uint8_t>& image, const std::vector<PatchRange>& ranges);
+
+// The flat binary program of --mmap-output, built in a shared file mapping that pass 2 encodes
+// into (see Assembler::set_output_mapper), so the bytes reach the page cache without an output
+// buffer or a write at the end. The mapping belongs to an unnamed temporary file in the target's
+// directory, which commit() puts in place of the target: a failed run leaves the target untouched.
+class MappedOutput {
+public:
+    explicit MappedOutput(const std::string& filename);
+    ~MappedOutput();
+    MappedOutput(const MappedOutput&) = delete;
+    MappedOutput& operator=(const MappedOutput&) = delete;
+
+    // Creates the temporary file with `size` bytes and maps it. Returns null where that is not
+    // possible (no mmap, or no O_TMPFILE on the file system); the program is then written as usual.
+    uint8_t* map(size_t size);
+    // Cuts the file to the `size` bytes of the program and moves it over the target. The mapping
+    // stays readable until destruction. Returns false if the file cannot be put in place.
+    bool commit(size_t size);
+
+private:
+    std::string filename;
+    int fd = -1;
+    void* mapping = nullptr;
+    size_t mapped_size = 0;
+};
+
+#endif // OUTPUT_WRITERS_H
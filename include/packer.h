@@ -0,0 +1,27 @@
+#ifndef PACKER_H
+#define PACKER_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// LZ stream of the self-extracting output. Each token byte is followed by its operands:
+//   0          end of stream
+//   1..127     that many literal bytes follow
+//   128..255   copy (token & 0x7F) + 3 bytes from earlier output; the 16-bit distance follows,
+//              negated, low byte first
+std::vector<uint8_t> lz_compress(const std::vector<uint8_t>& data);
+
+// A CP/M .com that unpacks a program to its origin and jumps to it.
+struct SelfExtractingImage {
+    std::vector<uint8_t> file;  // Loaded at 100H.
+    uint16_t high = 0;          // Where the decompressor and the packed data run from.
+    uint64_t states = 0;        // 8080 T-states to move and unpack the program.
+};
+
+// Packs the program `image`, which runs at `origin`, behind an 8080 stub. The stub first copies the
+// decompressor and the packed data up to max(origin + size, their load address), clear of the
+// program, and unpacks from there. Returns false with a message if that does not fit below 64 KiB.
+bool pack_self_extracting(const std::vector<uint8_t>& image, uint16_t origin, SelfExtractingImage& packed, std::string& error);
+
+#endif // PACKER_H
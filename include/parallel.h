@@ -0,0 +1,31 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+
+// Resolves a requested worker count: 0 means one per hardware thread.
+inline unsigned resolve_thread_count(unsigned requested) {
+    if (requested > 0) return requested;
+    unsigned hardware = std::thread::hardware_concurrency();
+    return hardware > 0 ? hardware : 1;
+}
+
+// Splits [0, count) into contiguous chunks and runs body(begin, end) for each chunk on its
+// own thread. With one thread (or one item) the body simply runs on the calling thread.
+template <typename Body>
+void parallel_for(size_t count, unsigned threads, Body body) {
+    size_t workers = std::min<size_t>(std::max(1u, threads), count);
+    if (workers <= 1) { if (count > 0) body(size_t(0), count); return; }
+    std::vector<std::thread> pool;
+    size_t chunk = (count + workers - 1) / workers;
+    for (size_t begin = 0; begin < count; begin += chunk) {
+        size_t end = std::min(count, begin + chunk);
+        pool.emplace_back([=]() { body(begin, end); });
+    }
+    for (auto& worker : pool) worker.join();
+}
+
+#endif // PARALLEL_H
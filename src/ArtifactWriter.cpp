@@ -0,0 +1,225 @@
+#include "artifact_writer.h"
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#define HAVE_IO_URING 1
+#endif
+
+namespace {
+
+#ifdef HAVE_IO_URING
+// Submission queue size; larger batches are written a ring-full at a time.
+const unsigned RING_ENTRIES = 128;
+
+// A minimal io_uring driven by the raw system calls, so no liburing is needed. Only whole-file
+// writes at offset 0 are queued.
+class IoRing {
+public:
+    explicit IoRing(unsigned entries) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof params);
+        fd = syscall(__NR_io_uring_setup, entries, &params);
+        if (fd < 0) return;
+        sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap) sq_size = cq_size = std::max(sq_size, cq_size);
+        sq_ring = map(sq_size, IORING_OFF_SQ_RING);
+        cq_ring = single_mmap ? sq_ring : map(cq_size, IORING_OFF_CQ_RING);
+        sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe*>(map(sqes_size, IORING_OFF_SQES));
+        if (!sq_ring || !cq_ring || !sqes) { release(); return; }
+
+        char* sq = static_cast<char*>(sq_ring);
+        char* cq = static_cast<char*>(cq_ring);
+        sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        capacity = std::min(params.sq_entries, params.cq_entries);
+    }
+    ~IoRing() { release(); }
+    IoRing(const IoRing&) = delete;
+    IoRing& operator=(const IoRing&) = delete;
+
+    bool ready() const { return fd >= 0; }
+    unsigned size() const { return capacity; }
+
+    // Pins the buffers in the kernel so writes from them skip the per-request page mapping.
+    bool register_buffers(const std::vector<iovec>& buffers) {
+        return syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS, buffers.data(), buffers.size()) == 0;
+    }
+
+    // Queues a write of `buffer` to the start of `file`, from registered buffer `fixed` if that is not negative.
+    void queue_write(int file, const iovec& buffer, int fixed, uint64_t tag) {
+        unsigned tail = *sq_tail;
+        unsigned slot = tail & sq_mask;
+        io_uring_sqe& sqe = sqes[slot];
+        std::memset(&sqe, 0, sizeof sqe);
+        sqe.fd = file;
+        sqe.off = 0;
+        sqe.user_data = tag;
+        if (fixed >= 0) {
+            sqe.opcode = IORING_OP_WRITE_FIXED;
+            sqe.addr = reinterpret_cast<uint64_t>(buffer.iov_base);
+            sqe.len = buffer.iov_len;
+            sqe.buf_index = fixed;
+        } else {
+            sqe.opcode = IORING_OP_WRITEV;
+            sqe.addr = reinterpret_cast<uint64_t>(&buffer);
+            sqe.len = 1;
+        }
+        sq_array[slot] = slot;
+        __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+        queued++;
+    }
+
+    // Submits the queued writes and waits until all have completed, calling done(tag, result) for
+    // each. Returns false if the ring fails: the writes the kernel never took are left to the
+    // blocking writes, and the ones it did are waited for first, so none of them is still in
+    // flight when the same file is written again.
+    template <typename Done>
+    bool wait_all(Done done) {
+        unsigned outstanding = queued;
+        queued = 0;
+        while (outstanding > 0) {
+            int result = syscall(__NR_io_uring_enter, fd, unsubmitted(), outstanding, IORING_ENTER_GETEVENTS, nullptr, 0);
+            int error = errno;
+            outstanding -= reap(done);
+            if (result >= 0 || error == EINTR) continue;
+            // Completions are posted to the shared queue without entering the ring, so they are polled.
+            unsigned in_flight = outstanding - unsubmitted();
+            while (in_flight > 0) {
+                unsigned reaped = reap(done);
+                in_flight -= reaped;
+                if (reaped == 0) { timespec pause = { 0, 1000000 }; nanosleep(&pause, nullptr); }
+            }
+            return false;
+        }
+        return true;
+    }
+
+private:
+    // Queued writes the kernel has not taken yet.
+    unsigned unsubmitted() const { return *sq_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE); }
+
+    // Hands every posted completion to done(tag, result) and returns how many there were.
+    template <typename Done>
+    unsigned reap(Done& done) {
+        unsigned head = *cq_head;
+        unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        unsigned count = tail - head;
+        for (; head != tail; ++head) {
+            const io_uring_cqe& cqe = cqes[head & cq_mask];
+            done(cqe.user_data, cqe.res);
+        }
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+        return count;
+    }
+
+    void* map(size_t length, off_t offset) {
+        void* mapping = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+        return mapping == MAP_FAILED ? nullptr : mapping;
+    }
+    void release() {
+        if (sqes) munmap(sqes, sqes_size);
+        if (cq_ring && cq_ring != sq_ring) munmap(cq_ring, cq_size);
+        if (sq_ring) munmap(sq_ring, sq_size);
+        if (fd >= 0) close(fd);
+        sqes = nullptr; sq_ring = cq_ring = nullptr; fd = -1;
+    }
+
+    int fd = -1;
+    void* sq_ring = nullptr;
+    void* cq_ring = nullptr;
+    io_uring_sqe* sqes = nullptr;
+    size_t sq_size = 0, cq_size = 0, sqes_size = 0;
+    unsigned* sq_head = nullptr;
+    unsigned* sq_tail = nullptr;
+    unsigned* sq_array = nullptr;
+    unsigned sq_mask = 0;
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    unsigned cq_mask = 0;
+    io_uring_cqe* cqes = nullptr;
+    unsigned capacity = 0;
+    unsigned queued = 0;                // Writes queued since the last wait_all.
+};
+
+// Writes the artifacts through a ring and marks in `done` those it wrote completely. Anything
+// it could not open, write in full or close is left to the blocking writes.
+void write_through_ring(const std::vector<const std::string*>& filenames, const std::vector<std::string*>& contents, std::vector<bool>& done) {
+    IoRing ring(std::min<size_t>(std::max<size_t>(filenames.size(), 1), RING_ENTRIES));
+    if (!ring.ready()) return;
+    std::vector<int> fds;
+    std::vector<size_t> queued;
+    std::vector<iovec> buffers;
+    for (size_t i = 0; i < filenames.size(); ++i) {
+        fds.push_back(open(filenames[i]->c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644));
+        if (fds[i] < 0) continue;
+        if (contents[i]->empty()) { done[i] = true; continue; }
+        queued.push_back(i);
+        buffers.push_back({ &(*contents[i])[0], contents[i]->size() });
+    }
+
+    bool fixed = !buffers.empty() && ring.register_buffers(buffers);
+    for (size_t first = 0; first < queued.size(); first += ring.size()) {
+        size_t last = std::min(queued.size(), first + ring.size());
+        for (size_t q = first; q < last; ++q) ring.queue_write(fds[queued[q]], buffers[q], fixed ? static_cast<int>(q) : -1, queued[q]);
+        bool ok = ring.wait_all([&](uint64_t tag, int result) { done[tag] = result >= 0 && static_cast<size_t>(result) == contents[tag]->size(); });
+        if (!ok) break;
+    }
+    for (size_t i = 0; i < fds.size(); ++i) {
+        if (fds[i] >= 0 && close(fds[i]) != 0) done[i] = false;
+    }
+}
+#endif
+
+} // namespace
+
+// A file added twice keeps only its last contents, as if the writes had been made one after
+// another; two writes to one file must not race on the ring.
+void ArtifactWriter::add(const std::string& filename, std::string contents) {
+    auto found = positions.find(filename);
+    if (found != positions.end()) { artifacts[found->second].contents = std::move(contents); return; }
+    positions.emplace(filename, artifacts.size());
+    artifacts.push_back({ filename, std::move(contents) });
+}
+
+bool ArtifactWriter::flush(std::vector<std::string>& failed) {
+    std::vector<bool> done(artifacts.size(), false);
+#ifdef HAVE_IO_URING
+    std::vector<const std::string*> filenames;
+    std::vector<std::string*> contents;
+    for (auto& artifact : artifacts) {
+        filenames.push_back(&artifact.filename);
+        contents.push_back(&artifact.contents);
+    }
+    write_through_ring(filenames, contents, done);
+#endif
+    // The blocking path: everything without a ring, and whatever the ring did not finish.
+    bool all_written = true;
+    for (size_t i = 0; i < artifacts.size(); ++i) {
+        if (done[i]) continue;
+        std::ofstream outfile(artifacts[i].filename, std::ios::binary);
+        outfile.write(artifacts[i].contents.data(), artifacts[i].contents.size());
+        if (!outfile) { failed.push_back(artifacts[i].filename); all_written = false; }
+    }
+    artifacts.clear();
+    positions.clear();
+    return all_written;
+}
@@ -1,5 +1,8 @@
 #include "debug.h"
 #include "Assembler.h"
+#include "macrolib.h"
+#include "parallel.h"
+#include "instructions.h"
 #include <algorithm>
 #include <sstream>
 #include <iomanip>
@@ -42,6 +45,160 @@ std::vector<std::string> split_args(const std::string& s, char delimiter) {
     return tokens;
 }
 
+// Splits a macro parameter or argument list. An empty list yields no entries.
+std::vector<std::string> split_macro_args(const std::string& s) {
+    std::string temp = s.substr(0, s.find(';'));
+    trim(temp);
+    if (temp.empty()) return {};
+    return split_args(temp, ',');
+}
+
+// Normalizes a macro argument for the expansion cache: whitespace is collapsed and
+// text outside quotes is lowercased, since symbols and numbers are case-insensitive.
+std::string normalize_macro_arg(const std::string& arg) {
+    std::string normalized;
+    char quote = 0;
+    for (char c : arg) {
+        if (c == '\'' || c == '"') { if (!quote) quote = c; else if (quote == c) quote = 0; }
+        if (!quote && std::isspace(static_cast<unsigned char>(c))) continue;
+        normalized += quote ? c : static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    return normalized;
+}
+
+// Returns the first word of a line, lowercased.
+std::string lower_first_word(const std::string& line) {
+    std::stringstream ss(line);
+    std::string word;
+    ss >> word;
+    to_lower(word);
+    return word;
+}
+
+// Checks for the directives that open a repeat block.
+bool is_repeat_keyword(const std::string& word) { return word == "rept" || word == "irp" || word == "irpc"; }
+
+// Finds the ENDM that closes the MACRO or repeat block opened at lines[start], skipping
+// nested repeat blocks. Returns lines.size() if the block is never closed.
+size_t find_block_end(const std::vector<std::string>& lines, size_t start) {
+    int depth = 0;
+    for (size_t i = start + 1; i < lines.size(); ++i) {
+        std::string word = lower_first_word(lines[i]);
+        if (is_repeat_keyword(word)) depth++;
+        else if (word == "endm" || word == "mend") { if (depth == 0) return i; depth--; }
+    }
+    return lines.size();
+}
+
+// Characters that can start or continue a symbol name inside a macro body.
+bool is_ident_start(char c) { return std::isalpha(static_cast<unsigned char>(c)) || c == '_' || c == '?' || c == '@'; }
+bool is_ident_char(char c) { return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '?' || c == '@' || c == '$'; }
+
+// Records, for each template line that opens a REPT/IRP/IRPC block, the line of its ENDM.
+// Unclosed blocks point past the end of the template.
+void index_repeat_blocks(Macro& macro) {
+    macro.block_ends.assign(macro.template_lines.size(), 0);
+    std::vector<size_t> open_blocks;
+    for (size_t i = 0; i < macro.template_lines.size(); ++i) {
+        const auto& segments = macro.template_lines[i];
+        std::string word = segments.empty() || segments[0].kind != MacroSegment::TEXT ? "" : lower_first_word(segments[0].text);
+        if (is_repeat_keyword(word)) open_blocks.push_back(i);
+        else if ((word == "endm" || word == "mend") && !open_blocks.empty()) { macro.block_ends[open_blocks.back()] = i; open_blocks.pop_back(); }
+    }
+    for (size_t i : open_blocks) macro.block_ends[i] = macro.template_lines.size();
+}
+
+// Compiles a macro body into template lines. Whole identifiers that match a parameter
+// or LOCAL name become slots, so a parameter "a" never matches inside "data".
+// Inside quotes only names joined with '&' are substituted (as in M80), and the '&' is dropped.
+void compile_macro(Macro& macro) {
+    std::vector<std::string> params = macro.params;
+    for (auto& param : params) to_lower(param);
+    macro.locals.clear();
+    macro.template_lines.clear();
+
+    // LOCAL lines inside nested REPT/IRP/IRPC blocks belong to those blocks.
+    int depth = 0;
+    for (const auto& body_line : macro.body_lines) {
+        std::string temp_body = body_line;
+        trim(temp_body);
+        std::stringstream ss(temp_body);
+        std::string body_first_word;
+        ss >> body_first_word;
+        to_lower(body_first_word);
+        if (is_repeat_keyword(body_first_word)) depth++;
+        if ((body_first_word == "endm" || body_first_word == "mend") && depth > 0) depth--;
+        if (body_first_word == "local" && depth == 0) {
+            std::string local_args_part;
+            std::getline(ss, local_args_part);
+            for (std::string label_name : split_macro_args(local_args_part)) {
+                to_lower(label_name);
+                macro.locals.push_back(label_name);
+            }
+        }
+    }
+
+    depth = 0;
+    for (const auto& body_line : macro.body_lines) {
+        std::string body_first_word = lower_first_word(body_line);
+        if (is_repeat_keyword(body_first_word)) depth++;
+        if ((body_first_word == "endm" || body_first_word == "mend") && depth > 0) depth--;
+        if (body_first_word == "local" && depth == 0) continue;
+
+        std::vector<MacroSegment> segments;
+        std::string literal;
+        char quote = 0;
+        size_t i = 0;
+        while (i < body_line.length()) {
+            char c = body_line[i];
+            if (!quote && c == ';') { literal += body_line.substr(i); break; }
+            if (c == '\'' || c == '"') {
+                if (!quote) quote = c; else if (quote == c) quote = 0;
+                literal += c; ++i; continue;
+            }
+            if (!is_ident_start(c)) {
+                // Numbers like "10h" are consumed whole so their suffix is never taken for a name.
+                if (std::isdigit(static_cast<unsigned char>(c))) { while (i < body_line.length() && is_ident_char(body_line[i])) literal += body_line[i++]; }
+                else { literal += c; ++i; }
+                continue;
+            }
+            size_t start = i;
+            while (i < body_line.length() && is_ident_char(body_line[i])) ++i;
+            std::string word = body_line.substr(start, i - start);
+            std::string lower_word = word;
+            to_lower(lower_word);
+            bool joined_before = !literal.empty() && literal.back() == '&';
+            bool joined_after = i < body_line.length() && body_line[i] == '&';
+            MacroSegment slot = { MacroSegment::TEXT, "", -1 };
+            auto param_it = std::find(params.begin(), params.end(), lower_word);
+            auto local_it = std::find(macro.locals.begin(), macro.locals.end(), lower_word);
+            if (param_it != params.end()) { slot.kind = MacroSegment::PARAM; slot.slot = param_it - params.begin(); }
+            else if (local_it != macro.locals.end()) { slot.kind = MacroSegment::LOCAL; slot.slot = local_it - macro.locals.begin(); }
+            if (slot.kind == MacroSegment::TEXT || (quote && !joined_before && !joined_after)) { literal += word; continue; }
+            if (joined_before) literal.pop_back();
+            if (joined_after) ++i;
+            if (!literal.empty()) { segments.push_back({ MacroSegment::TEXT, literal, -1 }); literal.clear(); }
+            segments.push_back(slot);
+        }
+        if (!literal.empty()) segments.push_back({ MacroSegment::TEXT, literal, -1 });
+        macro.template_lines.push_back(segments);
+    }
+    index_repeat_blocks(macro);
+}
+
+// Splices arguments and generated local label names into a compiled template line.
+void expand_macro_line(const std::vector<MacroSegment>& segments, const std::vector<std::string>& args,
+                       const std::vector<std::string>& local_names, std::string& out) {
+    out.clear();
+    for (const auto& segment : segments) {
+        switch (segment.kind) {
+            case MacroSegment::TEXT:  out += segment.text; break;
+            case MacroSegment::PARAM: if (segment.slot < static_cast<int>(args.size())) out += args[segment.slot]; break;
+            case MacroSegment::LOCAL: out += local_names[segment.slot]; break;
+        }
+    }
+}
+
 void Assembler::set_listing_stream(std::ostream& stream) {
     listing_stream = &stream;
 }
@@ -50,44 +207,279 @@ void Assembler::set_octal_mode(bool enabled){
     this->octal_mode = enabled;
 }
 
+void Assembler::set_cross_reference(bool enabled) {
+    cross_reference = enabled;
+}
+
+// With a mapper, pass 2 encodes into the memory it returns (see map_output). If the program ends up
+// there whole, getOutput() stays empty and the mapper's owner holds the program.
+void Assembler::set_output_mapper(OutputMapper mapper) {
+    output_mapper = std::move(mapper);
+}
+
+bool Assembler::is_output_mapped() const { return output_mapped; }
+
+void Assembler::set_line_table(bool enabled) {
+    line_table_enabled = enabled;
+}
+
+void Assembler::set_macro_profiling(bool enabled) {
+    macro_profiling = enabled;
+}
+
+void Assembler::set_expansion_limits(const ExpansionLimits& new_limits) {
+    limits = new_limits;
+}
+
+void Assembler::set_thread_count(unsigned count) {
+    thread_count = count;
+}
+
+void Assembler::set_error_prefix(const std::string& prefix) {
+    error_prefix = prefix;
+}
+
+void Assembler::set_throw_errors(bool enabled) {
+    throw_errors = enabled;
+}
+
 // --- Assembler Class Implementation ---
 // Constructor: Initializes the mnemonic handler map.
 Assembler::Assembler() { initialize_mnemonic_handlers(); reset_state(); }
 // Resets all state variables to their defaults for a fresh assembly run.
-void Assembler::reset_state() { lineno = 0; address = 0; source_pass = 1; assembly_finished = false; macro_expansion_counter = 0; output.clear(); symbol_table.clear(); macros.clear(); }
+void Assembler::reset_state() {
+    lineno = 0; address = 0; source_pass = 1; assembly_finished = false; macro_expansion_counter = 0; output.clear();
+    image.assign(0x10000, 0); use_own_image(); coverage.assign(0x10000 / 64, 0); emitted_bytes = 0; emit_address = 0; span_start = 0x10000; span_end = 0;
+    expansion_cache.clear(); repeat_blocks.clear(); redefinable_symbols.clear(); macro_profiles.clear(); expanded_lines = 0;
+    symbol_table.clear(); constant_symbols.clear(); cross_reference_data.clear(); line_table.clear();
+}
+
+// Adds the macros and equates of a precompiled library to every following assembly.
+void Assembler::add_macro_library(const MacroLibrary& library) {
+    for (const auto& pair : library.macros) {
+        Macro& macro = library_macros[pair.first] = pair.second;
+        index_repeat_blocks(macro);
+    }
+    for (const auto& pair : library.equates) library_equates[pair.first] = pair.second;
+}
+
+// Collects the macros and constant equates of the last assembly into a library.
+MacroLibrary Assembler::build_macro_library() const {
+    MacroLibrary library;
+    library.macros = source->macros;
+    for (const auto& name : constant_symbols) library.equates[name] = symbol_table.at(name);
+    return library;
+}
 
 // Public gettters for the final output.
 const std::vector<uint8_t>& Assembler::getOutput() const { return output; }
+uint16_t Assembler::getOutputOrigin() const { return output_origin; }
+size_t Assembler::getOutputSize() const { return output_size; }
+const std::vector<LineTableEntry>& Assembler::getLineTable() const { return line_table; }
+void Assembler::copy_output(uint8_t* destination) const { std::copy(window + (output_origin - window_start), window + (output_origin - window_start) + output_size, destination); }
 const std::map<std::string, uint16_t>& Assembler::getSymbolTable() const { return symbol_table; }
 const std::map<std::string, std::vector<int>>& Assembler::getCrossReferenceData() const { return cross_reference_data; }
+const std::map<std::string, MacroProfile>& Assembler::getMacroProfile() const { return macro_profiles; }
 
-// Reports an error message to the console and exits the program.
-void Assembler::report_error(const std::string& message, int line_num) const { std::cerr << "asm80> line " << (line_num + 1) << ": " << message << std::endl; exit(1); }
+// Reports an error message to the console and exits the program, or throws it with throw_errors.
+void Assembler::report_error(const std::string& message, int line_num) const {
+    std::string diagnostic = "asm80> " + error_prefix + "line " + std::to_string(line_num + 1) + ": " + message;
+    if (throw_errors) throw std::runtime_error(diagnostic);
+    std::cerr << diagnostic << std::endl;
+    exit(1);
+}
 
 // Main entry point for the assembly process.
 void Assembler::assemble(const std::vector<std::string>& lines) {
-    reset_state();
-    // Pass 0: Find all macro definitions before doing anything else.
-    preprocess_macros(lines);
-    // Pass 1: Build the symbol table.
-    source_pass = 1;
-    do_pass(lines);
+    assemble(prepare(lines));
+}
+
+// Pass 0: Find all macro definitions before doing anything else, then pre-expand the calls to them.
+// Preloaded library macros and equates are the starting point of every run.
+std::shared_ptr<const PreparedSource> Assembler::prepare(const std::vector<std::string>& lines) {
+    auto prepared = std::make_shared<PreparedSource>();
+    prepared->lines = lines;
+    prepared->macros = library_macros;
+    prepared->equates = library_equates;
+    preprocess_macros(*prepared);
+    source = prepared;
+    pre_expand_macros(*prepared);
+    size_lines(*prepared);
+    return prepared;
+}
+
+// Runs both passes over a prepared source. The prepared source is only read, so several
+// assemblers (with different -D symbols) can share it from different threads.
+void Assembler::assemble(std::shared_ptr<const PreparedSource> prepared) {
+    source = std::move(prepared);
+    wide_branches.clear();
+    // Pass 1: Build the symbol table. If a Z80 JR or DJNZ cannot reach its target, it is widened
+    // and pass 1 runs again with the new sizes, until every branch left short fits.
+    for (int round = 1; ; ++round) {
+        begin_assembly();
+        source_pass = 1;
+        run_pass();
+        if (!widen_branches()) break;
+        if (round == MAX_RELAXATION_ROUNDS) report_error("branch relaxation did not converge in " + std::to_string(MAX_RELAXATION_ROUNDS) + " passes", source->lines.size());
+    }
     // Pass 2: Generate the machine code.
     source_pass = 2;
     address = 0;
     output.clear();
     assembly_finished = false;
     macro_expansion_counter = 0;
-    do_pass(lines);
+    map_output();
+    run_pass();
+    extract_output();
+    if (line_table_enabled) sort_line_table();
+}
+
+// Resets the state for a pass 1, seeding the symbol table with the library equates and -D symbols.
+void Assembler::begin_assembly() {
+    reset_state();
+    symbol_table = source->equates;
+    for (const auto& pair : source->equates) constant_symbols.insert(pair.first);
+    for (const auto& pair : defined_symbols) { symbol_table[pair.first] = pair.second; constant_symbols.insert(pair.first); }
+    // Each assembly records its own bytes into the cache entries, so it works on a copy.
+    expansion_cache = source->expansions;
+}
+
+// Branch relaxation, after a pass 1: every short JR/DJNZ whose target (now that all symbols are
+// defined) is out of reach is marked wide for the next round. Returns whether any was. Branches
+// never shrink back, so the rounds converge.
+bool Assembler::widen_branches() {
+    bool widened = false;
+    uint16_t saved_address = address;
+    bool saved_cross_reference = cross_reference;
+    cross_reference = false;
+    for (const BranchSite& site : branch_sites) {
+        address = site.address;
+        lineno = site.line;
+        int displacement = static_cast<int16_t>(static_cast<uint16_t>(evaluate_expression(site.target) - site.address));
+        if (displacement >= -128 && displacement <= 127) continue;
+        if (wide_branches.size() <= site.ordinal) wide_branches.resize(site.ordinal + 1, false);
+        wide_branches[site.ordinal] = true;
+        widened = true;
+    }
+    cross_reference = saved_cross_reference;
+    address = saved_address;
+    return widened;
+}
+
+// Copies the written part of the image, from the lowest to the highest written address, into
+// the output. Gaps between ORG'd sections are zero; nothing below the first section is included.
+// A mapped program is left where it is, provided it starts at the first byte of the mapping.
+void Assembler::extract_output() {
+    std::vector<AddressRange> ranges = getOutputRanges();
+    output.clear();
+    output_origin = ranges.empty() ? 0 : ranges.front().start;
+    output_size = ranges.empty() ? 0 : ranges.back().start + ranges.back().size - output_origin;
+    if (output_mapped && output_origin != window_start) unmap_output();
+    if (!output_mapped) output.assign(image.begin() + output_origin, image.begin() + output_origin + output_size);
+}
+
+// Before pass 2: with an output mapper, the bytes pass 1 laid out get the mapper's memory instead
+// of the image, so pass 2 stores the program right where it is written. The image is dropped
+// meanwhile. Anything stored outside that span (say, a DS sized by a forward reference) makes
+// store() move everything back into the image.
+void Assembler::map_output() {
+    if (!output_mapper || span_end <= span_start || span_end > 0x10000) return;
+    uint8_t* mapping = output_mapper(span_end - span_start);
+    if (!mapping) return;
+    window = mapping;
+    window_start = span_start;
+    window_size = span_end - span_start;
+    output_mapped = true;
+    image.clear();
+    image.shrink_to_fit();
+}
+
+// Stops writing into the mapping: its bytes are copied into a fresh image, which takes over.
+void Assembler::unmap_output() {
+    const uint8_t* mapping = window;
+    uint16_t start = window_start;
+    uint32_t size = window_size;
+    use_own_image();
+    std::copy(mapping, mapping + size, image.begin() + start);
+}
+
+// Points the window at this assembler's own 64 KiB image (allocating it if it was dropped).
+void Assembler::use_own_image() {
+    if (image.size() != 0x10000) image.assign(0x10000, 0);
+    window = image.data();
+    window_start = 0;
+    window_size = 0x10000;
+    output_mapped = false;
+}
+
+uint8_t& Assembler::image_at(uint16_t at) { return window[at - window_start]; }
+
+// Pass 1: widens the span of laid out addresses by `size` bytes at the location counter.
+void Assembler::extend_span(size_t size) {
+    span_start = std::min<uint32_t>(span_start, address);
+    span_end = std::max<uint32_t>(span_end, address + size);
+}
+
+// Lists the address ranges written in pass 2, in address order, found word by word in the coverage bitmap.
+std::vector<AddressRange> Assembler::getOutputRanges() const {
+    std::vector<AddressRange> ranges;
+    bool open = false;
+    for (size_t word = 0; word < coverage.size(); ++word) {
+        uint64_t bits = coverage[word];
+        if ((open && bits == ~0ULL) || (!open && bits == 0)) continue;
+        for (size_t bit = 0; bit < 64; ++bit) {
+            bool covered = (bits >> bit) & 1;
+            size_t at = word * 64 + bit;
+            if (covered && !open) { ranges.push_back({ static_cast<uint16_t>(at), 0 }); open = true; }
+            else if (!covered && open) { ranges.back().size = at - ranges.back().start; open = false; }
+        }
+    }
+    if (open) ranges.back().size = 0x10000 - ranges.back().start;
+    return ranges;
+}
+
+// Parses a -D definition, NAME or NAME=VALUE (VALUE in the source's number syntax, default 1).
+// Returns false if it is malformed.
+bool Assembler::define_symbol(const std::string& definition) {
+    size_t equals = definition.find('=');
+    std::string name = definition.substr(0, equals);
+    std::string value = equals == std::string::npos ? "1" : definition.substr(equals + 1);
+    trim(name); trim(value); to_lower(name);
+    if (name.empty() || !is_ident_start(name[0]) || value.empty()) return false;
+    for (char c : name) if (!is_ident_char(c)) return false;
+    int base = 10;
+    char last = std::tolower(static_cast<unsigned char>(value.back()));
+    if (last == 'h') base = 16; else if (last == 'q' || last == 'o') base = 8; else if (last == 'b') base = 2;
+    if (base != 10 || last == 'd') value.pop_back();
+    try {
+        size_t used = 0;
+        unsigned long number = std::stoul(value, &used, base);
+        if (used != value.length() || number > 0xFFFF) return false;
+        defined_symbols[name] = number;
+    } catch (const std::exception&) {
+        return false;
+    }
+    return true;
 }
 
 // Pass 0: Iterates through the source code to find and store all macro definitions.
-void Assembler::preprocess_macros(const std::vector<std::string>& lines) {
+// It also indexes the block structure of the source: where each macro definition, repeat block
+// and top-level IF/ELSE branch ends, so the passes can jump over them.
+void Assembler::preprocess_macros(PreparedSource& prepared) {
+    const std::vector<std::string>& lines = prepared.lines;
+    std::vector<SourceLine>& source_index = prepared.index;
     bool in_macro_def = false;
+    int block_depth = 0;
+    int macro_start = 0;
+    std::vector<int> open_blocks, open_conditionals;
     Macro current_macro;
+    Cpu line_cpu = Cpu::I8080;
+    source_index.assign(lines.size(), SourceLine());
     for (int i = 0; i < lines.size(); ++i) {
+        source_index[i].cpu = line_cpu;
         std::string temp_line = lines[i];
         trim(temp_line);
+        if (temp_line.empty()) { source_index[i].kind = SourceLine::BLANK; continue; }
         std::stringstream ss(temp_line);
         std::string first_word, second_word;
         ss >> first_word >> second_word;
@@ -96,81 +488,300 @@ void Assembler::preprocess_macros(const std::vector<std::string>& lines) {
         if (second_word == "macro") {
             if (in_macro_def) report_error("nested macro definitions are not supported", i);
             in_macro_def = true;
+            macro_start = i;
+            source_index[i].kind = SourceLine::MACRO_DEF;
             current_macro = Macro();
             current_macro.name = first_word;
             std::string params_part;
             std::getline(ss, params_part);
-            current_macro.params = split_args(params_part, ',');
+            current_macro.params = split_macro_args(params_part);
+        } else if (is_repeat_keyword(first_word)) {
+            // REPT/IRP/IRPC blocks share ENDM with macros, so their nesting is tracked.
+            block_depth++;
+            open_blocks.push_back(i);
+            source_index[i].kind = SourceLine::REPEAT_BLOCK;
+            if (in_macro_def) current_macro.body_lines.push_back(lines[i]);
+        } else if ((first_word == "endm" || first_word == "mend") && block_depth > 0) {
+            block_depth--;
+            source_index[open_blocks.back()].end = i;
+            open_blocks.pop_back();
+            if (in_macro_def) current_macro.body_lines.push_back(lines[i]);
         } else if (first_word == "endm" || first_word == "mend") {
             if (!in_macro_def) report_error("ENDM without MACRO", i);
             in_macro_def = false;
-            macros[current_macro.name] = current_macro;
+            source_index[macro_start].end = i;
+            compile_macro(current_macro);
+            prepared.macros[current_macro.name] = current_macro;
         } else if (in_macro_def) {
             current_macro.body_lines.push_back(lines[i]);
+        } else if (block_depth == 0 && first_word == "if") {
+            source_index[i].kind = SourceLine::CONDITIONAL;
+            open_conditionals.push_back(i);
+        } else if (block_depth == 0 && first_word == "else" && !open_conditionals.empty()) {
+            source_index[i].kind = SourceLine::CONDITIONAL;
+            source_index[open_conditionals.back()].end = i;
+            open_conditionals.back() = i;
+        } else if (block_depth == 0 && first_word == "endif" && !open_conditionals.empty()) {
+            source_index[open_conditionals.back()].end = i;
+            open_conditionals.pop_back();
+        } else if (block_depth == 0 && is_cpu_directive(first_word)) {
+            line_cpu = cpu_from_directive(first_word);
         }
     }
     if (in_macro_def) report_error("MACRO definition not closed with ENDM", lines.size());
+    if (block_depth > 0) report_error("REPT block not closed with ENDM", lines.size());
+}
+
+// Runs the current pass with the driver instantiated for the outputs it has to produce. The
+// listing (and so its octal format) only exists in pass 2.
+void Assembler::run_pass() {
+    using Driver = void (Assembler::*)(const std::vector<std::string>&);
+    static const Driver drivers[2][2] = {
+        { &Assembler::do_pass<PassPolicy<false, false>>, &Assembler::do_pass<PassPolicy<false, true>> },
+        { &Assembler::do_pass<PassPolicy<true, false>>,  &Assembler::do_pass<PassPolicy<true, true>> },
+    };
+    bool listing = source_pass == 2 && listing_stream;
+    (this->*drivers[listing][listing && octal_mode])(source->lines);
 }
 
 // Main loop for Pass 1 and Pass 2. Skips macro definitions and passes other lines to the processor.
+// Uses the source index from pass 0: an IF or ELSE that leaves its block inactive jumps straight
+// to the matching ELSE/ENDIF, so code in false conditional blocks is never looked at.
+template <class Policy>
 void Assembler::do_pass(const std::vector<std::string>& lines) {
-    bool in_macro_def = false;
     if_stack.clear();
-    for (lineno = 0; lineno < lines.size(); ++lineno) {
+    inactive_blocks = 0;
+    expanded_lines = 0;
+    pass_bytes = 0;
+    cpu = Cpu::I8080;
+    branch_ordinal = 0;
+    if (source_pass == 1) { checkpoints.clear(); branch_sites.clear(); }
+    if (source_pass == 2 && run_parallel_pass<Policy>(lines)) return;
+    run_lines<Policy>(lines, 0, lines.size());
+    if (!if_stack.empty()) report_error("IF block not closed with ENDIF", lines.size());
+}
+
+// Runs the pass over source lines [first, last). Pass 1 leaves a checkpoint of the pass state
+// every CHECKPOINT_INTERVAL lines, so pass 2 can later start from any of them.
+template <class Policy>
+void Assembler::run_lines(const std::vector<std::string>& lines, int first, int last) {
+    int next_checkpoint = first;
+    for (lineno = first; lineno < last; ++lineno) {
         if (assembly_finished) break;
-        std::string current_line = lines[lineno];
+        if (source_pass == 1 && lineno >= next_checkpoint) {
+            checkpoints.push_back({ lineno, address, macro_expansion_counter, expanded_lines, pass_bytes, if_stack, inactive_blocks, cpu, branch_ordinal });
+            next_checkpoint = lineno + CHECKPOINT_INTERVAL;
+        }
+        const std::string& current_line = lines[lineno];
+        const SourceLine& info = source->index[lineno];
 
         // Updating for listing file logic
         uint16_t line_address = this->address;
-        size_t bytes_before = this->output.size();
+        size_t bytes_before = emitted_bytes;
+        line_emit_mark = emitted_bytes;
+        line_emit_address = line_address;
 
-        std::string temp_line = current_line;
-        trim(temp_line);
-        if (temp_line.empty()) { if (source_pass == 2 && listing_stream) { *listing_stream << current_line << std::endl;} continue;} 
-        std::stringstream ss(temp_line);
-        std::string first_word, second_word;
-        ss >> first_word >> second_word;
-        to_lower(second_word);
-        if (second_word == "macro") in_macro_def = true;
-        if (in_macro_def) {
-            std::string lower_first;
-            std::stringstream(temp_line) >> lower_first;
-            to_lower(lower_first);
-            if (lower_first == "endm" || lower_first == "mend") in_macro_def = false;
+        if (info.kind == SourceLine::BLANK) { if (Policy::listing) { *listing_stream << current_line << std::endl;} continue;} 
+        if (info.kind == SourceLine::MACRO_DEF) { lineno = info.end; continue; }
+
+        // Pass 1 only needs the label and size of a line, which were worked out (in parallel)
+        // when the source was prepared; only the address assignment is left to do here. The sizes
+        // assume the instruction set read top to bottom, so they are used only when that is the one in effect.
+        if (source_pass == 1 && info.kind == SourceLine::STATEMENT && source->sizes[lineno].size >= 0 && info.cpu == cpu && !should_skip()) {
+            label = source->sizes[lineno].label;
+            pass_action(source->sizes[lineno].size);
             continue;
         }
-        expand_and_process_line(current_line, lineno);
-
-        // Listing File Logic
-        if (source_pass == 2 && listing_stream) {
-            size_t bytes_after = this->output.size();
-            std::stringstream line_data_stream;
-
-            // Selecting Hex or Octor formatting
-            if (this->octal_mode) {
-                // format address and bytes in OCTAL
-                line_data_stream << std::oct << std::setfill('0') << std::setw(6) << line_address << "  ";
-                for (size_t i = bytes_before; i < bytes_after; ++i) {
-                    line_data_stream << std:: setw(3) << static_cast<int>(output[i]) << " ";
-                }
-            } else {
-                // Formatting address and bytes in HEXADECIMAL (default)
-                line_data_stream << std::hex << std::uppercase << std::setfill('0') << std::setw(4) << line_address << "  ";
-                for (size_t i = bytes_before; i < bytes_after; ++i) {
-                    line_data_stream << std::setw(2) << static_cast<int>(output[i]) << " ";
-                }
+
+        // REPT/IRP/IRPC blocks are compiled once and iterated by run_repeat_block.
+        int block_end = -1;
+        if (info.kind == SourceLine::REPEAT_BLOCK) {
+            block_end = info.end;
+            if (!should_skip()) {
+                auto found = repeat_blocks.find(lineno);
+                if (found == repeat_blocks.end()) found = repeat_blocks.emplace(lineno, compile_repeat_block(lines, lineno, block_end)).first;
+                start_repeat_block(current_line, found->second, lineno);
+                run_expansion(lineno);
             }
+        } else {
+            expand_and_process_line(current_line, lineno);
+        }
 
-            
-            // Write the final formatted line to the listing file
-            *listing_stream << std::left << std::setw(20) << line_data_stream.str() << current_line << std::endl;
+        if (Policy::listing) write_listing_line<Policy::octal>(line_address, bytes_before, current_line);
+        if (block_end >= 0) lineno = block_end;
+
+        // A false IF (or the ELSE of a true one) jumps to the line that can end the inactive branch.
+        if (info.kind == SourceLine::CONDITIONAL && info.end >= 0 && should_skip()) {
+            if (Policy::listing) list_skipped_lines<Policy::octal>(lines, lineno + 1, info.end);
+            lineno = info.end - 1;
         }
     }
-    if (!if_stack.empty()) report_error("IF block not closed with ENDIF", lines.size());
 }
 
-// The recursive heart of the assembler. It expands macros, handles conditional assembly, and sends normal instructions to be parsed.
+// Pass 2 on worker threads. Once pass 1 has fixed every address and symbol, each run of lines
+// between two checkpoints can be encoded on its own: workers are copies of this assembler that
+// start from a checkpoint's state and write to their own image, listing and xref buffers, which
+// are merged here in source order. A worker must end in exactly the state of the next checkpoint
+// and no two may write the same address; otherwise, or on any error, this returns false and the
+// pass runs serially, so the result (or the error reported) is always that of the serial pass.
+// SET symbols change value during the pass, so sources using them always run serially.
+template <class Policy>
+bool Assembler::run_parallel_pass(const std::vector<std::string>& lines) {
+    unsigned threads = resolve_thread_count(thread_count);
+    if (threads < 2 || checkpoints.size() < 2 * threads || !redefinable_symbols.empty()) return false;
+
+    struct Slice { size_t first_checkpoint; int last_line; std::unique_ptr<Assembler> worker; std::stringstream listing; bool ok = false; };
+    std::vector<Slice> slices(threads);
+    for (unsigned t = 0; t < threads; ++t) {
+        slices[t].first_checkpoint = checkpoints.size() * t / threads;
+        size_t next = checkpoints.size() * (t + 1) / threads;
+        slices[t].last_line = next < checkpoints.size() ? checkpoints[next].line : lines.size();
+    }
+    for (auto& slice : slices) {
+        const PassCheckpoint& start = checkpoints[slice.first_checkpoint];
+        slice.worker = std::make_unique<Assembler>(*this);
+        Assembler& worker = *slice.worker;
+        worker.throw_errors = true;
+        worker.use_own_image();
+        worker.cross_reference_data.clear();
+        worker.macro_profiles.clear();
+        worker.listing_stream = Policy::listing ? &slice.listing : nullptr;
+        worker.address = start.address;
+        worker.macro_expansion_counter = start.macro_expansion_counter;
+        worker.expanded_lines = start.expanded_lines;
+        worker.pass_bytes = start.pass_bytes;
+        worker.if_stack = start.if_stack;
+        worker.inactive_blocks = start.inactive_blocks;
+        worker.cpu = start.cpu;
+        worker.branch_ordinal = start.branch_ordinal;
+    }
+
+    parallel_for(slices.size(), threads, [&](size_t begin, size_t end) {
+        for (size_t t = begin; t < end; ++t) {
+            Slice& slice = slices[t];
+            Assembler& worker = *slice.worker;
+            try {
+                worker.run_lines<Policy>(lines, checkpoints[slice.first_checkpoint].line, slice.last_line);
+            } catch (const std::exception&) {
+                // Reported errors and anything else thrown (e.g. std::stoi on a bad number) leave
+                // the slice to the serial pass, which reports it as usual.
+                continue;
+            }
+            // The slice must hand over exactly the state the next one starts from.
+            size_t next = t + 1 < slices.size() ? slices[t + 1].first_checkpoint : checkpoints.size();
+            if (next == checkpoints.size()) { slice.ok = true; continue; }
+            const PassCheckpoint& handover = checkpoints[next];
+            slice.ok = !worker.assembly_finished && worker.lineno == handover.line && worker.address == handover.address
+                && worker.macro_expansion_counter == handover.macro_expansion_counter && worker.inactive_blocks == handover.inactive_blocks
+                && worker.cpu == handover.cpu && worker.branch_ordinal == handover.branch_ordinal
+                && std::equal(worker.if_stack.begin(), worker.if_stack.end(), handover.if_stack.begin(), handover.if_stack.end(),
+                    [](const ConditionalBlock& a, const ConditionalBlock& b) { return a.active == b.active && a.in_else == b.in_else; });
+        }
+    });
+
+    std::vector<uint64_t> merged(coverage.size(), 0);
+    for (const auto& slice : slices) {
+        if (!slice.ok) return false;
+        for (size_t word = 0; word < merged.size(); ++word) {
+            if (merged[word] & slice.worker->coverage[word]) return false;
+            merged[word] |= slice.worker->coverage[word];
+        }
+    }
+
+    for (const auto& slice : slices) {
+        const Assembler& worker = *slice.worker;
+        for (size_t word = 0; word < coverage.size(); ++word) {
+            for (uint64_t bits = worker.coverage[word]; bits; bits &= bits - 1) {
+                size_t at = word * 64 + __builtin_ctzll(bits);
+                if (at < window_start || at >= window_start + window_size) unmap_output();
+                image_at(at) = worker.image[at];
+            }
+        }
+        line_table.insert(line_table.end(), worker.line_table.begin(), worker.line_table.end());
+        for (const auto& pair : worker.cross_reference_data) {
+            auto& refs = cross_reference_data[pair.first];
+            refs.insert(refs.end(), pair.second.begin(), pair.second.end());
+        }
+        for (const auto& pair : worker.macro_profiles) {
+            MacroProfile& profile = macro_profiles[pair.first];
+            profile.invocations += pair.second.invocations;
+            profile.lines += pair.second.lines;
+            profile.bytes += pair.second.bytes;
+            profile.seconds += pair.second.seconds;
+        }
+        if (Policy::listing) *listing_stream << slice.listing.rdbuf();
+        emitted_bytes += worker.emitted_bytes;
+    }
+    coverage = std::move(merged);
+    const Assembler& last = *slices.back().worker;
+    address = last.address;
+    lineno = last.lineno;
+    assembly_finished = last.assembly_finished;
+    macro_expansion_counter = last.macro_expansion_counter;
+    expanded_lines = last.expanded_lines;
+    pass_bytes = last.pass_bytes;
+    if_stack = last.if_stack;
+    inactive_blocks = last.inactive_blocks;
+    cpu = last.cpu;
+    branch_ordinal = last.branch_ordinal;
+    DEBUG_LOG("Pass 2 encoded in " << slices.size() << " slices");
+    return true;
+}
+
+// Listing File Logic: writes a source line with its address and the bytes it generated.
+template <bool Octal>
+void Assembler::write_listing_line(uint16_t line_address, size_t bytes_before, const std::string& line) {
+    size_t bytes_after = emitted_bytes;
+    std::stringstream line_data_stream;
+
+    // Selecting Hex or Octor formatting
+    if (Octal) {
+        // format address and bytes in OCTAL
+        line_data_stream << std::oct << std::setfill('0') << std::setw(6) << line_address << "  ";
+        for (size_t i = bytes_before; i < bytes_after; ++i) {
+            line_data_stream << std:: setw(3) << static_cast<int>(image_at(line_emit_address + i - bytes_before)) << " ";
+        }
+    } else {
+        // Formatting address and bytes in HEXADECIMAL (default)
+        line_data_stream << std::hex << std::uppercase << std::setfill('0') << std::setw(4) << line_address << "  ";
+        for (size_t i = bytes_before; i < bytes_after; ++i) {
+            line_data_stream << std::setw(2) << static_cast<int>(image_at(line_emit_address + i - bytes_before)) << " ";
+        }
+    }
+
+    // Write the final formatted line to the listing file
+    *listing_stream << std::left << std::setw(20) << line_data_stream.str() << line << std::endl;
+}
+
+// Lists the lines of a jumped-over conditional branch [first, last) as the line-by-line walk would have.
+template <bool Octal>
+void Assembler::list_skipped_lines(const std::vector<std::string>& lines, int first, int last) {
+    for (int i = first; i < last; ++i) {
+        const SourceLine& info = source->index[i];
+        if (info.kind == SourceLine::BLANK) { *listing_stream << lines[i] << std::endl; continue; }
+        if (info.kind == SourceLine::MACRO_DEF) { i = info.end; continue; }
+        write_listing_line<Octal>(address, emitted_bytes, lines[i]);
+        if (info.kind == SourceLine::REPEAT_BLOCK) i = info.end;
+    }
+}
+
+// Processes one source line together with any macro or repeat-block expansion it starts.
+// Expansion runs from an explicit stack of frames, so nesting never recurses.
 void Assembler::expand_and_process_line(const std::string& line, int original_lineno) {
+    process_line({ &line, original_lineno, 0 });
+    run_expansion(original_lineno);
+}
+
+// Drains the expansion stack, handing each produced line to process_line.
+void Assembler::run_expansion(int original_lineno) {
+    LineRecord record;
+    while (next_expanded_line(record, original_lineno)) process_line(record);
+}
+
+// The heart of the assembler. Handles conditional assembly, starts macro expansions, and sends normal instructions to be parsed.
+void Assembler::process_line(const LineRecord& record) {
+    const std::string& line = *record.text;
+    int original_lineno = record.source_line;
     std::string temp_line = line;
     trim(temp_line);
     if(temp_line.empty() || temp_line[0] == ';') return;
@@ -186,11 +797,22 @@ void Assembler::expand_and_process_line(const std::string& line, int original_li
         std::string condition_expr;
         std::getline(ss, condition_expr);
         bool condition_result = is_active ? evaluate_conditional(condition_expr) : false;
-        if_stack.push_back(condition_result);
+        if_stack.push_back({ condition_result, false });
+        if (!condition_result) inactive_blocks++;
+        return;
+    }
+    if (lower_first == "else") {
+        if (if_stack.empty() || if_stack.back().in_else) report_error("ELSE without IF", original_lineno);
+        ConditionalBlock& block = if_stack.back();
+        block.in_else = true;
+        // The ELSE branch is active only if the IF branch was not and every enclosing block is.
+        if (block.active) { block.active = false; inactive_blocks++; }
+        else if (inactive_blocks == 1) { block.active = true; inactive_blocks--; }
         return;
     }
     if (lower_first == "endif") {
         if (if_stack.empty()) report_error("ENDIF without IF", original_lineno);
+        if (!if_stack.back().active) inactive_blocks--;
         if_stack.pop_back();
         return;
     }
@@ -199,53 +821,48 @@ void Assembler::expand_and_process_line(const std::string& line, int original_li
     // Ignore directives that don't generate code.
     if (lower_first == "error" || lower_first == "local") return;
 
-    // If the first word is a defined macro, expand it.
-    if (macros.count(lower_first)) {
-        const auto& macro_def = macros.at(lower_first);
+    // If the first word is a defined macro, push a frame to expand it.
+    if (source->macros.count(lower_first)) {
+        const auto& macro_def = source->macros.at(lower_first);
         macro_expansion_counter++;
         std::string args_part;
         std::getline(ss, args_part);
-        std::vector<std::string> args = split_args(args_part, ',');
+        std::vector<std::string> args = split_macro_args(args_part);
         if (args.size() != macro_def.params.size()) { report_error("macro '" + macro_def.name + "' argument count mismatch", original_lineno); }
+        size_t depth_before = expansion_stack.size();
+        std::chrono::steady_clock::time_point started;
+        if (macro_profiling) started = std::chrono::steady_clock::now();
+        uint64_t lines_before = expanded_lines;
+        size_t bytes_before = emitted_bytes;
 
-        // Find and prepare unique names for local labels.
-        std::map<std::string, std::string> local_label_map;
-        for (const auto& body_line : macro_def.body_lines) {
-            std::string temp_body = body_line;
-            trim(temp_body);
-            std::string body_first_word;
-            std::stringstream(temp_body) >> body_first_word;
-            to_lower(body_first_word);
-            if (body_first_word == "local") {
-                std::string local_args_part;
-                std::stringstream(temp_body) >> body_first_word >> local_args_part;
-                std::vector<std::string> local_labels = split_args(local_args_part, ',');
-                for (const auto& label_name : local_labels) {
-                    local_label_map[label_name] = label_name + "_" + std::to_string(macro_expansion_counter);
-                }
+        if (macro_def.locals.empty()) {
+            // Without LOCAL labels the expansion depends only on the arguments, so it can be memoized.
+            expand_cached_macro(macro_def, args, original_lineno);
+        } else {
+            // Prepare unique names for local labels; the template is spliced line by line as the frame runs.
+            ExpansionFrame frame;
+            frame.macro = &macro_def;
+            frame.origin = &macro_def;
+            frame.args = std::move(args);
+            for (const auto& label_name : macro_def.locals) {
+                frame.local_names.push_back(label_name + "_" + std::to_string(macro_expansion_counter));
             }
+            push_frame(std::move(frame), original_lineno);
         }
 
-        // Process each line in the macro's body.
-        for (std::string body_line : macro_def.body_lines) {
-            // Substitute parameters with arguments.
-            for (size_t i = 0; i < macro_def.params.size(); ++i) {
-                size_t pos = 0;
-                while ((pos = body_line.find(macro_def.params[i], pos)) != std::string::npos) {
-                    body_line.replace(pos, macro_def.params[i].length(), args[i]);
-                    pos += args[i].length();
-                }
-            }
-            // Substitute local labels with their unique generated names.
-            for (const auto& pair : local_label_map) {
-                 size_t pos = 0;
-                while ((pos = body_line.find(pair.first, pos)) != std::string::npos) {
-                    body_line.replace(pos, pair.first.length(), pair.second);
-                    pos += pair.second.length();
-                }
+        // A pushed frame is charged to the macro when it finishes; a replayed expansion right away.
+        if (macro_profiling) {
+            MacroProfile& profile = macro_profiles[macro_def.name];
+            if (expansion_stack.size() > depth_before) {
+                ExpansionFrame& frame = expansion_stack.back();
+                frame.profile = &profile;
+                frame.profile_start = started;
+                frame.profile_lines = lines_before;
+                frame.profile_bytes = bytes_before;
+                profile.active++;
+            } else {
+                account_profile(profile, started, lines_before, bytes_before);
             }
-            // Recursively process the expanded line.
-            expand_and_process_line(body_line, original_lineno);
         }
     } else {
         // If it's not a macro or directive, it's a normal instruction.
@@ -255,19 +872,320 @@ void Assembler::expand_and_process_line(const std::string& line, int original_li
     }
 }
 
+// Produces the next line from the innermost expansion frame. Finished frames are popped
+// (or start their next iteration), and nested repeat blocks get a frame of their own.
+// Returns false once the stack is empty.
+bool Assembler::next_expanded_line(LineRecord& record, int original_lineno) {
+    while (!expansion_stack.empty()) {
+        ExpansionFrame& frame = expansion_stack.back();
+        size_t line_count = frame.macro ? frame.macro->template_lines.size() : frame.lines->size();
+        if (frame.next_line >= line_count || assembly_finished) {
+            if (++frame.iteration < frame.iterations && !assembly_finished) begin_iteration(frame);
+            else finish_frame();
+            continue;
+        }
+
+        size_t index = frame.next_line++;
+        const std::string* text = &expansion_buffer;
+        if (frame.macro) expand_macro_line(frame.macro->template_lines[index], frame.args, frame.local_names, expansion_buffer);
+        else text = &(*frame.lines)[index];
+
+        // Nested REPT/IRP/IRPC blocks are compiled from their expanded text and run in their own frame.
+        size_t block_end = frame.macro ? frame.macro->block_ends[index] : (is_repeat_keyword(lower_first_word(*text)) ? find_block_end(*frame.lines, index) : 0);
+        if (block_end > 0) {
+            if (block_end >= line_count) report_error("REPT block not closed with ENDM", original_lineno);
+            frame.next_line = block_end + 1;
+            if (should_skip()) continue;
+            std::vector<std::string> block_lines(1, *text);
+            for (size_t i = index + 1; i <= block_end; ++i) {
+                block_lines.emplace_back();
+                if (frame.macro) expand_macro_line(frame.macro->template_lines[i], frame.args, frame.local_names, block_lines.back());
+                else block_lines.back() = (*frame.lines)[i];
+            }
+            auto block = std::make_shared<const Macro>(compile_repeat_block(block_lines, 0, block_lines.size() - 1));
+            start_repeat_block(block_lines[0], *block, original_lineno, block);
+            continue;
+        }
+
+        record = { text, original_lineno, static_cast<int>(expansion_stack.size()) };
+        if (++expanded_lines > limits.max_lines) report_expansion_limit("expanded line limit (" + std::to_string(limits.max_lines) + ") exceeded", original_lineno);
+        return true;
+    }
+    return false;
+}
+
+// Sets up a repeat-block frame for its next iteration: the IRP/IRPC argument and fresh LOCAL labels.
+void Assembler::begin_iteration(ExpansionFrame& frame) {
+    if (!frame.items.empty()) frame.args[0] = frame.items[frame.iteration];
+    if (frame.macro && !frame.macro->locals.empty()) {
+        macro_expansion_counter++;
+        for (size_t i = 0; i < frame.macro->locals.size(); ++i) frame.local_names[i] = frame.macro->locals[i] + "_" + std::to_string(macro_expansion_counter);
+    }
+    frame.next_line = 0;
+}
+
+// Pops the innermost frame, storing its results in the expansion cache if it was recording.
+void Assembler::finish_frame() {
+    ExpansionFrame& frame = expansion_stack.back();
+    if (frame.recording) {
+        ExpansionCacheEntry& entry = *frame.recording;
+        int pass_index = source_pass - 1;
+        xref_capture = nullptr;
+        entry.recorded[pass_index] = true;
+        entry.xrefs[pass_index] = std::move(xref_captured);
+        entry.size = address - frame.start_address;
+        if (source_pass == 2) {
+            // Replayable expansions hold no ORG, so their bytes are contiguous from the start address.
+            entry.bytes.resize(emitted_bytes - frame.start_output);
+            for (size_t i = 0; i < entry.bytes.size(); ++i) entry.bytes[i] = image_at(frame.start_address + i);
+        }
+    }
+    if (frame.profile) {
+        frame.profile->active--;
+        account_profile(*frame.profile, frame.profile_start, frame.profile_lines, frame.profile_bytes);
+    }
+    expansion_stack.pop_back();
+}
+
+// Pushes an expansion frame, enforcing the nesting depth budget.
+void Assembler::push_frame(ExpansionFrame&& frame, int original_lineno) {
+    if (expansion_stack.size() >= limits.max_depth) {
+        expansion_stack.push_back(std::move(frame));
+        report_expansion_limit("macro expansion depth limit (" + std::to_string(limits.max_depth) + ") exceeded", original_lineno);
+    }
+    expansion_stack.push_back(std::move(frame));
+}
+
+// Reports a blown expansion budget along with a backtrace of the open expansions,
+// innermost first. Deep backtraces show their ends and elide the middle.
+void Assembler::report_expansion_limit(const std::string& message, int original_lineno) const {
+    std::stringstream trace;
+    trace << message;
+    size_t depth = expansion_stack.size();
+    for (size_t i = depth; i-- > 0;) {
+        if (depth > 20 && i == depth - 11) { trace << "\n    ... " << (depth - 20) << " more expansions ..."; i = 9; }
+        const ExpansionFrame& frame = expansion_stack[i];
+        std::string name = frame.origin ? frame.origin->name : "?";
+        std::transform(name.begin(), name.end(), name.begin(), ::toupper);
+        trace << "\n    in " << name;
+        if (frame.next_line > 0) trace << ", body line " << frame.next_line;
+        if (frame.iterations > 1) trace << ", iteration " << (frame.iteration + 1) << " of " << frame.iterations;
+    }
+    trace << "\n    from source line " << (original_lineno + 1);
+    report_error(trace.str(), original_lineno);
+}
+
+// Charges one finished expansion to a macro's profile. Counts come from pass 2 only, time from
+// both passes. A recursive call inside an open frame of the same macro only adds an invocation,
+// since the outermost frame already covers its lines, bytes and time.
+void Assembler::account_profile(MacroProfile& profile, std::chrono::steady_clock::time_point started, uint64_t start_lines, size_t start_bytes) {
+    if (source_pass == 2) profile.invocations++;
+    if (profile.active > 0) return;
+    profile.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    if (source_pass == 2) {
+        profile.lines += expanded_lines - start_lines;
+        profile.bytes += emitted_bytes - start_bytes;
+    }
+}
+
+// Expands a macro through the expansion cache. The first expansion of an argument tuple is
+// run from the cached lines while recording; later ones replay the recorded size and bytes when that is safe.
+void Assembler::expand_cached_macro(const Macro& macro_def, const std::vector<std::string>& args, int original_lineno) {
+    std::string key = expansion_cache_key(macro_def, args, cpu);
+    auto found = expansion_cache.find(key);
+    if (found == expansion_cache.end()) found = expansion_cache.emplace(key, expand_for_cache(macro_def, args)).first;
+    ExpansionCacheEntry& entry = found->second;
+    int pass_index = source_pass - 1;
+
+    // SET symbols change during pass 2, so recorded bytes are only trusted without them.
+    bool values_fixed = source_pass == 1 || redefinable_symbols.empty();
+    if (entry.replayable && entry.recorded[pass_index] && values_fixed) {
+        if (cross_reference) for (const auto& term : entry.xrefs[pass_index]) cross_reference_data[term].push_back(original_lineno + 1);
+        emit_address = address;
+        if (source_pass == 2) { replay_depth = 1; emit(entry.bytes.data(), entry.bytes.size()); replay_depth = 0; }
+        else if (entry.size > 0) extend_span(entry.size);
+        address += entry.size;
+        expanded_lines += entry.lines.size();
+        pass_bytes += entry.size;
+        if (expanded_lines > limits.max_lines) report_expansion_limit("expanded line limit (" + std::to_string(limits.max_lines) + ") exceeded", original_lineno);
+        if (pass_bytes > limits.max_bytes) report_expansion_limit("output size limit (" + std::to_string(limits.max_bytes) + " bytes) exceeded", original_lineno);
+        return;
+    }
+
+    // Replayable expansions hold no nested macros or blocks, so at most one frame records at a time.
+    ExpansionFrame frame;
+    frame.lines = &entry.lines;
+    frame.origin = &macro_def;
+    if (entry.replayable) {
+        frame.recording = &entry;
+        frame.start_address = address;
+        frame.start_output = emitted_bytes;
+        xref_captured.clear();
+        if (cross_reference) xref_capture = &xref_captured;
+    }
+    push_frame(std::move(frame), original_lineno);
+}
+
+// Builds the expansion cache key of a macro call: the instruction set it is expanded under (the
+// same text encodes differently, or not at all, on another one), the macro name and its normalized arguments.
+std::string Assembler::expansion_cache_key(const Macro& macro_def, const std::vector<std::string>& args, Cpu line_cpu) const {
+    std::string key(1, static_cast<char>('0' + static_cast<int>(line_cpu)));
+    key += macro_def.name;
+    for (const auto& arg : args) { key += '\x1f'; key += normalize_macro_arg(arg); }
+    return key;
+}
+
+// Expands a macro without LOCAL labels into a fresh cache entry. Only reads shared state,
+// so pre_expand_macros can run it on several threads at once.
+ExpansionCacheEntry Assembler::expand_for_cache(const Macro& macro_def, const std::vector<std::string>& args) const {
+    ExpansionCacheEntry entry;
+    std::string body_line;
+    for (const auto& template_line : macro_def.template_lines) {
+        expand_macro_line(template_line, args, {}, body_line);
+        entry.replayable = entry.replayable && is_replayable_line(body_line);
+        entry.lines.push_back(body_line);
+    }
+    return entry;
+}
+
+// Expands the source-level macro calls into the expansion cache on a pool of threads before
+// pass 1, so the passes find their line IR ready. Text expansion never depends on '$' or on
+// symbol values; only macros with LOCAL labels are left out, as their label numbering follows
+// expansion order. Entries are keyed by the instruction set read top to bottom, so a call the
+// passes reach under another one simply misses. Nested calls are still expanded by the passes.
+void Assembler::pre_expand_macros(PreparedSource& prepared) {
+    struct Task { const Macro* macro; std::vector<std::string> args; std::string key; ExpansionCacheEntry entry; };
+    std::vector<Task> tasks;
+    std::set<std::string> seen;
+    for (size_t i = 0; i < prepared.lines.size(); ++i) {
+        const SourceLine& info = prepared.index[i];
+        if (info.kind == SourceLine::MACRO_DEF || info.kind == SourceLine::REPEAT_BLOCK) { i = info.end; continue; }
+        if (info.kind != SourceLine::STATEMENT) continue;
+        std::string temp_line = prepared.lines[i];
+        trim(temp_line);
+        std::string first_word = lower_first_word(temp_line);
+        auto found = prepared.macros.find(first_word);
+        if (found == prepared.macros.end() || !found->second.locals.empty()) continue;
+        std::string args_part = temp_line.substr(std::min(temp_line.length(), temp_line.find_first_of(" \t")));
+        std::vector<std::string> args = split_macro_args(args_part);
+        if (args.size() != found->second.params.size()) continue;
+        std::string key = expansion_cache_key(found->second, args, info.cpu);
+        if (!seen.insert(key).second) continue;
+        tasks.push_back({ &found->second, std::move(args), std::move(key), {} });
+    }
+    // Small sources are not worth the threads; the passes expand lazily instead.
+    if (tasks.size() < 64) return;
+
+    parallel_for(tasks.size(), resolve_thread_count(thread_count), [&](size_t begin, size_t end) {
+        for (size_t t = begin; t < end; ++t) tasks[t].entry = expand_for_cache(*tasks[t].macro, tasks[t].args);
+    });
+    for (auto& task : tasks) prepared.expansions.emplace(std::move(task.key), std::move(task.entry));
+}
+
+// Compiles the body of the REPT/IRP/IRPC block between lines[start] and its ENDM.
+// IRP and IRPC blocks get their dummy parameter as the single macro parameter.
+Macro Assembler::compile_repeat_block(const std::vector<std::string>& lines, size_t start, size_t end) {
+    std::string header = lines[start];
+    trim(header);
+    std::stringstream ss(header);
+    Macro block;
+    ss >> block.name;
+    to_lower(block.name);
+    if (block.name != "rept") {
+        std::string rest;
+        std::getline(ss, rest);
+        std::vector<std::string> parts = split_macro_args(rest);
+        if (parts.size() != 2) report_error(block.name + " needs a dummy parameter and an argument list", start);
+        block.params.push_back(parts[0]);
+    }
+    block.body_lines.assign(lines.begin() + start + 1, lines.begin() + end);
+    compile_macro(block);
+    return block;
+}
+
+// Pushes a frame that iterates a compiled repeat block: REPT n times, IRP once per list item,
+// IRPC once per character. Each iteration splices its argument into the same template, so the
+// body is never copied N times. `owner` keeps blocks compiled during expansion alive.
+void Assembler::start_repeat_block(const std::string& header, const Macro& block, int original_lineno, std::shared_ptr<const Macro> owner) {
+    std::string temp_line = header.substr(0, header.find(';'));
+    trim(temp_line);
+    std::stringstream ss(temp_line);
+    std::string keyword, rest;
+    ss >> keyword;
+    std::getline(ss, rest);
+    this->lineno = original_lineno;
+
+    ExpansionFrame frame;
+    if (block.name == "rept") {
+        frame.iterations = evaluate_expression(rest);
+        if (frame.iterations < 0) report_error("REPT count cannot be negative", original_lineno);
+    } else {
+        std::vector<std::string> parts = split_macro_args(rest);
+        std::string list = parts.size() == 2 ? parts[1] : "";
+        if (list.length() >= 2 && list.front() == '<' && list.back() == '>') list = list.substr(1, list.length() - 2);
+        if (block.name == "irp") frame.items = split_macro_args(list);
+        else for (char c : list) frame.items.push_back(std::string(1, c));
+        frame.iterations = frame.items.size();
+    }
+    if (frame.iterations == 0) return;
+
+    frame.macro = &block;
+    frame.origin = &block;
+    frame.owner = std::move(owner);
+    frame.args.resize(block.params.size());
+    frame.local_names.resize(block.locals.size());
+    begin_iteration(frame);
+    push_frame(std::move(frame), original_lineno);
+}
+
+// Checks whether an expanded macro line always produces the same bytes, whatever the
+// location counter, so its result can be replayed from the expansion cache.
+bool Assembler::is_replayable_line(const std::string& line) const {
+    std::string temp_line = line.substr(0, line.find(';'));
+    trim(temp_line);
+    if (temp_line.empty()) return true;
+    std::string lower_line = temp_line;
+    to_lower(lower_line);
+    std::string first_word;
+    std::stringstream(lower_line) >> first_word;
+    static const char* const stateful[] = { "if", "else", "endif", "org", "end", "equ", "set", "defl", "ds", "local", "rept", "irp", "irpc", "endm", ".8080", ".8085u", ".z80", "jr", "djnz" };
+    for (const char* directive : stateful) { if (first_word == directive) return false; }
+    if (source->macros.count(first_word)) return false;
+    if (lower_line.find(':') != std::string::npos || lower_line.find(" equ ") != std::string::npos) return false;
+    if (lower_line.find(" set ") != std::string::npos || lower_line.find(" defl ") != std::string::npos) return false;
+    bool in_quotes = false;
+    for (char c : temp_line) {
+        if (c == '\'' || c == '"') in_quotes = !in_quotes;
+        if (c == '$' && !in_quotes) return false;
+    }
+    return true;
+}
+
 // Main parser to break a line into label, mnemonic, and operands.
-void Assembler::parse(std::string line) {
-    label = mnemonic = operand1 = operand2 = comment = "";
+void Assembler::parse(const std::string& line) {
+    ParsedLine parsed = parse_line(line);
+    label = std::move(parsed.label); mnemonic = std::move(parsed.mnemonic); operand1 = std::move(parsed.operand1); operand2 = std::move(parsed.operand2); comment = std::move(parsed.comment);
+}
+
+// Splits a line into label, mnemonic, operands and comment. Depends on nothing but the text,
+// so pass-1 sizing can call it from any thread.
+ParsedLine parse_line(std::string line) {
+    ParsedLine parsed;
+    std::string& label = parsed.label; std::string& mnemonic = parsed.mnemonic; std::string& operand1 = parsed.operand1; std::string& operand2 = parsed.operand2; std::string& comment = parsed.comment;
     std::replace(line.begin(), line.end(), '\t', ' ');
     size_t comment_pos = line.find(';');
     if (comment_pos != std::string::npos) { comment = line.substr(comment_pos + 1); line = line.substr(0, comment_pos); trim(comment); }
     trim(line);
-    if (line.empty()) return;
+    if (line.empty()) return parsed;
 
-    // Special handling for EQU directives without a colon.
+    // Special handling for EQU, SET and DEFL directives without a colon. (A colon means a label,
+    // as in the Z80 "loop: set 0,a", and the line is parsed normally.)
     std::string temp_upper = line; to_lower(temp_upper);
-    size_t equ_pos = temp_upper.find(" equ ");
-    if (equ_pos != std::string::npos) { label = line.substr(0, equ_pos); mnemonic = "equ"; operand1 = line.substr(equ_pos + 5); trim(label); trim(operand1); to_lower(label); return; }
+    for (const char* directive : { "equ", "set", "defl" }) {
+        std::string spaced = std::string(" ") + directive + " ";
+        size_t equ_pos = temp_upper.find(spaced);
+        if (equ_pos != std::string::npos && line.find(':') > equ_pos) { label = line.substr(0, equ_pos); mnemonic = directive; operand1 = line.substr(equ_pos + spaced.length()); trim(label); trim(operand1); to_lower(label); return parsed; }
+    }
 
      // Standard parsing for lines with colon-terminated labels.
     size_t label_pos = line.find(':');
@@ -291,45 +1209,420 @@ void Assembler::parse(std::string line) {
     else { operand1 = operands_part; }
     if (mnemonic.empty() && !operand1.empty()) { mnemonic = operand1; operand1 = ""; }
     to_lower(label); to_lower(mnemonic);
+    return parsed;
+}
+
+// Whether an operand is a valid register name for a register-class operand; the pure
+// counterpart of register_field, which reports the error.
+static bool is_register_operand(OperandClass operand_class, std::string op) {
+    to_lower(op);
+    if (operand_class == OperandClass::REG8) return op.length() == 1 && std::string("bcdehlma").find(op[0]) != std::string::npos;
+    if (operand_class == OperandClass::PAIR_BD) return op == "b" || op == "d";
+    if (op == "b" || op == "bc" || op == "d" || op == "de" || op == "h" || op == "hl") return true;
+    return (operand_class == OperandClass::PAIR && op == "sp") || (operand_class == OperandClass::PAIR_PSW && op == "psw");
+}
+
+// How an operand matched a Z80 operand class: its register field, the DD/FD prefix of an IX/IY
+// operand, and the text left to evaluate in pass 2 (a value, or the displacement of (IX+d)).
+struct Z80Operand {
+    int field = 0;
+    uint8_t index = 0;
+    bool displaced = false;
+    std::string expr;
+};
+
+// The prefix byte selecting IX or IY in place of HL, or 0.
+static uint8_t index_prefix(const std::string& name) { return name == "ix" ? 0xDD : name == "iy" ? 0xFD : 0; }
+
+// Whether the whole operand is one parenthesized group: "(hl)" or "(buf+1)", but not "(1)+(2)".
+static bool is_indirect(const std::string& op) {
+    if (op.length() < 2 || op.front() != '(' || op.back() != ')') return false;
+    int depth = 0;
+    for (size_t i = 0; i < op.length(); ++i) {
+        if (op[i] == '(') depth++;
+        else if (op[i] == ')' && --depth == 0 && i + 1 < op.length()) return false;
+    }
+    return true;
+}
+
+// Matches one operand against a Z80 operand class. Register names are compared without blanks
+// or case; values keep their text, since blanks matter to operators like AND.
+static bool match_z80_operand(OperandClass operand_class, const std::string& text, Z80Operand& out) {
+    std::string op = text;
+    op.erase(std::remove_if(op.begin(), op.end(), [](unsigned char c) { return std::isspace(c); }), op.end());
+    to_lower(op);
+    auto field_of = [](const std::string& name, std::initializer_list<const char*> names) {
+        int field = 0;
+        for (const char* candidate : names) { if (name == candidate) return field; ++field; }
+        return -1;
+    };
+    static const std::initializer_list<const char*> registers = { "a", "b", "c", "d", "e", "h", "l", "i", "r", "af", "af'", "bc", "de", "hl", "sp", "ix", "iy" };
+    bool indirect = is_indirect(op);
+    std::string inner = indirect ? op.substr(1, op.length() - 2) : "";
+    uint8_t inner_index = index_prefix(inner.substr(0, 2));
+    bool indexed = inner_index && (inner.length() == 2 || inner[2] == '+' || inner[2] == '-');
+    std::string value = text;
+    trim(value);
+    switch (operand_class) {
+        case OperandClass::NONE: return op.empty();
+        case OperandClass::Z_A: return op == "a";
+        case OperandClass::Z_R8:
+            if (indexed) {
+                // (IX-d) is evaluated as 0-(d): the expression parser would read "-d" as a number.
+                value = value.substr(1, value.length() - 2);
+                trim(value);
+                value = value.substr(2);
+                trim(value);
+                out = { 6, inner_index, true, value.empty() ? "0" : (value[0] == '-' ? "0-(" : "0+(") + value.substr(1) + ")" };
+                return true;
+            }
+            out.field = field_of(op, { "b", "c", "d", "e", "h", "l", "(hl)", "a" });
+            return out.field >= 0;
+        case OperandClass::Z_RP:
+        case OperandClass::Z_RP_AF:
+            out.index = index_prefix(op);
+            out.field = out.index ? 2 : field_of(op, { "bc", "de", "hl", operand_class == OperandClass::Z_RP ? "sp" : "af" });
+            return out.field >= 0;
+        case OperandClass::Z_HL: return op == "hl";
+        case OperandClass::Z_HLX: out.index = index_prefix(op); return op == "hl" || out.index;
+        case OperandClass::Z_DE: return op == "de";
+        case OperandClass::Z_SP: return op == "sp";
+        case OperandClass::Z_AF: return op == "af";
+        case OperandClass::Z_AF_ALT: return op == "af'";
+        case OperandClass::Z_I: return op == "i";
+        case OperandClass::Z_R: return op == "r";
+        case OperandClass::Z_IND_BC: return op == "(bc)";
+        case OperandClass::Z_IND_DE: return op == "(de)";
+        case OperandClass::Z_IND_SP: return op == "(sp)";
+        case OperandClass::Z_IND_C: return op == "(c)";
+        case OperandClass::Z_IND_HL: out.index = inner_index; return inner == "hl" || (inner_index && inner.length() == 2);
+        case OperandClass::Z_IND_NN:
+        case OperandClass::Z_IND_N:
+            if (!indirect || indexed || field_of(inner, registers) >= 0) return false;
+            out.expr = value.substr(1, value.length() - 2);
+            return true;
+        case OperandClass::Z_CC: out.field = field_of(op, { "nz", "z", "nc", "c", "po", "pe", "p", "m" }); return out.field >= 0;
+        case OperandClass::Z_CC_JR: out.field = field_of(op, { "nz", "z", "nc", "c" }); return out.field >= 0;
+        case OperandClass::IMM8: case OperandClass::IMM16: case OperandClass::Z_BIT:
+        case OperandClass::Z_RST: case OperandClass::Z_IM: case OperandClass::Z_REL:
+            if (op.empty() || indirect || field_of(op, registers) >= 0) return false;
+            out.expr = value;
+            return true;
+        default: return false;
+    }
+}
+
+// Finds the first form of a Z80 mnemonic that the operands match, or returns null. IX and IY cannot
+// be mixed or combined with an ED prefix; IX/IY as the 16-bit destination takes itself as the source
+// but not HL (ADD IX,HL), and LD (HL),(HL) would be HALT's opcode.
+static const InstructionSpec* match_z80(InstructionRange forms, const std::string& operand1, const std::string& operand2, Z80Operand (&ops)[2]) {
+    for (const InstructionSpec* spec = forms.first; spec != forms.last; ++spec) {
+        ops[0] = Z80Operand();
+        ops[1] = Z80Operand();
+        if (!match_z80_operand(spec->operand1, operand1, ops[0]) || !match_z80_operand(spec->operand2, operand2, ops[1])) continue;
+        uint8_t index = ops[0].index | ops[1].index;
+        if (ops[0].index && ops[1].index && ops[0].index != ops[1].index) continue;
+        if (index && spec->prefix == 0xED) continue;
+        if (spec->operand2 == OperandClass::Z_RP && ops[1].field == 2 && ops[0].index != ops[1].index) continue;
+        if (spec->operand1 == OperandClass::Z_R8 && spec->operand2 == OperandClass::Z_R8 && ops[0].field == 6 && ops[1].field == 6) continue;
+        return spec;
+    }
+    return nullptr;
+}
+
+// Bytes of a matched Z80 form: the spec's size plus the IX/IY prefix and displacement.
+static int z80_size(const InstructionSpec& spec, const Z80Operand (&ops)[2]) {
+    return spec.size + ((ops[0].index | ops[1].index) ? 1 : 0) + ((ops[0].displaced || ops[1].displaced) ? 1 : 0);
 }
 
-// Dispatches a parsed instruction to the correct handler function.
+// Works out the pass-1 effect of a top-level line from its text alone: the label it defines and
+// the bytes it occupies. Only lines whose size cannot depend on a symbol qualify: valid instructions
+// (but not JR/DJNZ, which relaxation may widen), DB, DW and bare labels. Anything else (directives, macro calls, conditionals, errors) gets size -1
+// and is left to the serial pass.
+LineSize Assembler::size_line(const std::string& line, const std::map<std::string, Macro>& macros, Cpu line_cpu) const {
+    LineSize sized;
+    std::string first_word = lower_first_word(line);
+    if (first_word.empty() || first_word[0] == ';') { sized.size = 0; return sized; }
+    if (first_word == "if" || first_word == "else" || first_word == "endif" || first_word == "error" || first_word == "local" || macros.count(first_word)) return sized;
+
+    ParsedLine parsed = parse_line(line);
+    if (parsed.mnemonic.empty()) { sized.size = 0; sized.label = parsed.label; return sized; }
+    InstructionRange forms = find_instructions(line_cpu, parsed.mnemonic);
+    if (line_cpu == Cpu::Z80 && !forms.empty()) {
+        Z80Operand ops[2];
+        const InstructionSpec* spec = match_z80(forms, parsed.operand1, parsed.operand2, ops);
+        if (!spec || spec->operand1 == OperandClass::Z_REL || spec->operand2 == OperandClass::Z_REL) return sized;
+        sized.size = z80_size(*spec, ops);
+    } else if (!forms.empty()) {
+        const InstructionSpec* spec = forms.first;
+        const OperandClass classes[2] = { spec->operand1, spec->operand2 };
+        const std::string* operands[2] = { &parsed.operand1, &parsed.operand2 };
+        for (int i = 0; i < 2; ++i) {
+            if ((classes[i] != OperandClass::NONE) == operands[i]->empty() || classes[i] == OperandClass::RST) return sized;
+            if (classes[i] != OperandClass::NONE && classes[i] != OperandClass::IMM8 && classes[i] != OperandClass::IMM16 && !is_register_operand(classes[i], *operands[i])) return sized;
+        }
+        sized.size = spec->size;
+    } else if (parsed.mnemonic == "db" || parsed.mnemonic == "dw") {
+        std::string all_operands = parsed.operand1;
+        if (!parsed.operand2.empty()) all_operands += "," + parsed.operand2;
+        if (all_operands.empty()) return sized;
+        int size = 0;
+        for (const auto& arg : split_args(all_operands, ',')) {
+            std::string temp_arg = arg;
+            trim(temp_arg);
+            if (parsed.mnemonic == "dw") size += 2;
+            else if (temp_arg.length() > 2 && temp_arg.front() == '<' && temp_arg.back() == '>') size += split_args(temp_arg.substr(1, temp_arg.length() - 2), ',').size();
+            else if (is_quote_delimited(temp_arg)) size += temp_arg.length() - 2;
+            else size += 1;
+        }
+        sized.size = size;
+    } else {
+        return sized;
+    }
+    sized.label = parsed.label;
+    return sized;
+}
+
+// Sizes every top-level statement line of a prepared source, on worker threads for large sources.
+void Assembler::size_lines(PreparedSource& prepared) const {
+    prepared.sizes.assign(prepared.lines.size(), LineSize());
+    std::vector<size_t> statements;
+    for (size_t i = 0; i < prepared.lines.size(); ++i) {
+        const SourceLine& info = prepared.index[i];
+        if (info.kind == SourceLine::MACRO_DEF || info.kind == SourceLine::REPEAT_BLOCK) { i = info.end; continue; }
+        if (info.kind == SourceLine::STATEMENT) statements.push_back(i);
+    }
+    unsigned threads = statements.size() < 4096 ? 1 : resolve_thread_count(thread_count);
+    parallel_for(statements.size(), threads, [&](size_t begin, size_t end) {
+        for (size_t s = begin; s < end; ++s) prepared.sizes[statements[s]] = size_line(prepared.lines[statements[s]], prepared.macros, prepared.index[statements[s]].cpu);
+    });
+}
+
+// Dispatches a parsed instruction to the generic encoder, or a directive to its handler function.
 void Assembler::process_instruction() {
     if (mnemonic.empty() && label.empty()) return;
-    if (mnemonic_handlers.count(mnemonic)) {
+    InstructionRange forms = find_instructions(cpu, mnemonic);
+    // SET with a single operand is the directive; the Z80 instruction always has two.
+    if (cpu == Cpu::Z80 && !forms.empty() && !(mnemonic == "set" && operand2.empty())) {
+        encode_z80(forms);
+    } else if (cpu != Cpu::Z80 && !forms.empty()) {
+        encode_instruction(*forms.first);
+    } else if (mnemonic_handlers.count(mnemonic)) {
         (this->*mnemonic_handlers[mnemonic])();
     } else if (mnemonic.empty() && !label.empty()) {
-        pass_action(0, {});
+        pass_action(0);
     } else if (!mnemonic.empty()) {
         report_error("unknown mnemonic \"" + mnemonic + "\"", this->lineno);
     }
 }
 
-// Handles the action for each line based on the current pass.
-void Assembler::pass_action(int instruction_size, const std::vector<uint8_t>& output_bytes, bool should_add_label) {
+// Handles the action for each line based on the current pass: adds the label in pass 1 and
+// advances the location counter. The bytes themselves are emitted separately, in pass 2,
+// at the address the location counter had here.
+void Assembler::pass_action(int instruction_size, bool should_add_label) {
     if (source_pass == 1) {
         if (!label.empty() && should_add_label) { add_label(); }
-    } else {
-        output.insert(output.end(), output_bytes.begin(), output_bytes.end());
+        if (instruction_size > 0) extend_span(instruction_size);
     }
+    emit_address = address;
     address += instruction_size;
+    pass_bytes += instruction_size;
+    if (pass_bytes > limits.max_bytes) report_expansion_limit("output size limit (" + std::to_string(limits.max_bytes) + " bytes) exceeded", this->lineno);
+}
+
+// Encodes any instruction from its spec: checks the operand count, shifts the register fields
+// into the opcode and appends the immediate bytes in pass 2.
+void Assembler::encode_instruction(const InstructionSpec& spec) {
+    const OperandClass classes[2] = { spec.operand1, spec.operand2 };
+    const std::string* operands[2] = { &operand1, &operand2 };
+    const uint8_t shifts[2] = { spec.shift1, spec.shift2 };
+    check_operands((classes[0] != OperandClass::NONE) == !operand1.empty() && (classes[1] != OperandClass::NONE) == !operand2.empty(), spec.mnemonic);
+    uint8_t opcode = spec.opcode;
+    for (int i = 0; i < 2; ++i) {
+        if (classes[i] == OperandClass::NONE || classes[i] == OperandClass::IMM8 || classes[i] == OperandClass::IMM16) continue;
+        opcode |= register_field(classes[i], *operands[i]) << shifts[i];
+    }
+    pass_action(spec.size);
+    if (source_pass != 2) return;
+    uint8_t bytes[4] = { opcode };
+    size_t count = 1;
+    for (int i = 0; i < 2; ++i) {
+        if (classes[i] != OperandClass::IMM8 && classes[i] != OperandClass::IMM16) continue;
+        uint16_t value = evaluate_expression(*operands[i]);
+        bytes[count++] = value & 0xFF;
+        if (classes[i] == OperandClass::IMM16) bytes[count++] = value >> 8;
+    }
+    emit(bytes, count);
+}
+
+// Encodes a Z80 instruction in the first form its operands match. The bytes are
+// [DD/FD] [CB/ED] opcode [displacement] [immediate], except that indexed CB forms put the
+// displacement before the opcode (DD CB d op).
+void Assembler::encode_z80(InstructionRange forms) {
+    Z80Operand ops[2];
+    const InstructionSpec* spec = match_z80(forms, operand1, operand2, ops);
+    if (!spec) { report_error("invalid operands for mnemonic \"" + mnemonic + "\"", this->lineno); return; }
+    const OperandClass classes[2] = { spec->operand1, spec->operand2 };
+    if (classes[0] == OperandClass::Z_REL) { encode_relative_branch(*spec, ops[0].expr, -1); return; }
+    if (classes[1] == OperandClass::Z_REL) { encode_relative_branch(*spec, ops[1].expr, ops[0].field); return; }
+    pass_action(z80_size(*spec, ops));
+    if (source_pass != 2) return;
+
+    const uint8_t shifts[2] = { spec->shift1, spec->shift2 };
+    static const uint8_t interrupt_modes[3] = { 0x46, 0x56, 0x5E };
+    uint8_t opcode = spec->opcode;
+    int displacement = 0;
+    bool displaced = false;
+    for (int i = 0; i < 2; ++i) {
+        int value = 0;
+        switch (classes[i]) {
+            case OperandClass::Z_R8: case OperandClass::Z_RP: case OperandClass::Z_RP_AF: case OperandClass::Z_CC: case OperandClass::Z_CC_JR:
+                opcode |= ops[i].field << shifts[i];
+                break;
+            case OperandClass::Z_BIT:
+                value = evaluate_expression(ops[i].expr);
+                if (value < 0 || value > 7) report_error("invalid bit number", this->lineno);
+                opcode |= value << shifts[i];
+                break;
+            case OperandClass::Z_RST:
+                value = evaluate_expression(ops[i].expr);
+                if (value & ~0x38) report_error("invalid restart vector", this->lineno);
+                opcode |= value;
+                break;
+            case OperandClass::Z_IM:
+                value = evaluate_expression(ops[i].expr);
+                if (value < 0 || value > 2) { report_error("invalid interrupt mode", this->lineno); return; }
+                opcode = interrupt_modes[value];
+                break;
+            default: break;
+        }
+        if (ops[i].displaced) {
+            displaced = true;
+            displacement = evaluate_expression(ops[i].expr);
+            if (displacement < -128 || displacement > 127) report_error("index displacement out of range", this->lineno);
+        }
+    }
+
+    uint8_t bytes[6];
+    size_t count = 0;
+    if (ops[0].index | ops[1].index) bytes[count++] = ops[0].index | ops[1].index;
+    if (spec->prefix) bytes[count++] = spec->prefix;
+    if (spec->prefix == 0xCB && displaced) bytes[count++] = displacement & 0xFF;
+    bytes[count++] = opcode;
+    if (spec->prefix != 0xCB && displaced) bytes[count++] = displacement & 0xFF;
+    for (int i = 0; i < 2; ++i) {
+        bool word = classes[i] == OperandClass::IMM16 || classes[i] == OperandClass::Z_IND_NN;
+        if (!word && classes[i] != OperandClass::IMM8 && classes[i] != OperandClass::Z_IND_N) continue;
+        uint16_t value = evaluate_expression(ops[i].expr);
+        bytes[count++] = value & 0xFF;
+        if (word) bytes[count++] = value >> 8;
+    }
+    emit(bytes, count);
+}
+
+// Encodes JR or DJNZ (`condition` is the JR condition field, -1 for none). Branches start short;
+// one that relaxation found out of reach becomes JP (JP cc for JR cc), and DJNZ becomes DEC B / JP NZ.
+// Pass 1 records the short ones for widen_branches to check.
+void Assembler::encode_relative_branch(const InstructionSpec& spec, const std::string& target, int condition) {
+    size_t ordinal = branch_ordinal++;
+    bool wide = ordinal < wide_branches.size() && wide_branches[ordinal];
+    bool djnz = spec.opcode == 0x10;
+    pass_action(wide ? (djnz ? 4 : 3) : 2);
+    if (source_pass != 2) {
+        if (!wide) branch_sites.push_back({ ordinal, address, target, this->lineno });
+        return;
+    }
+    uint16_t destination = evaluate_expression(target);
+    if (wide) {
+        uint8_t bytes[4];
+        size_t count = 0;
+        if (djnz) bytes[count++] = 0x05;
+        bytes[count++] = djnz ? 0xC2 : condition < 0 ? 0xC3 : 0xC2 | condition << 3;
+        bytes[count++] = destination & 0xFF;
+        bytes[count++] = destination >> 8;
+        emit(bytes, count);
+        return;
+    }
+    // The location counter is already past the branch, which is where the displacement counts from.
+    int displacement = static_cast<int16_t>(static_cast<uint16_t>(destination - address));
+    if (displacement < -128 || displacement > 127) report_error("relative jump out of range", this->lineno);
+    const uint8_t bytes[2] = { static_cast<uint8_t>(condition < 0 ? spec.opcode : spec.opcode | condition << spec.shift1), static_cast<uint8_t>(displacement & 0xFF) };
+    emit(bytes, 2);
+}
+
+// Writes bytes into the image at the emit address (bytes == null writes `fill` instead). The range is
+// claimed in the coverage bitmap a 64-bit word at a time; writing an address twice is an error.
+void Assembler::store(const uint8_t* bytes, uint8_t fill, size_t count) {
+    if (emitted_bytes == line_emit_mark) line_emit_address = emit_address;
+    emitted_bytes += count;
+    while (count > 0) {
+        size_t chunk = std::min(count, static_cast<size_t>(0x10000 - emit_address));
+        for (size_t at = emit_address; at < emit_address + chunk;) {
+            size_t bit = at % 64, bits = std::min(chunk - (at - emit_address), 64 - bit);
+            uint64_t mask = (bits == 64 ? ~0ULL : ((1ULL << bits) - 1)) << bit;
+            uint64_t overlap = coverage[at / 64] & mask;
+            if (overlap) {
+                std::stringstream where;
+                where << std::hex << std::uppercase << std::setfill('0') << std::setw(4) << (at / 64 * 64 + __builtin_ctzll(overlap)) << "H";
+                report_error("overlapping output at address " + where.str(), this->lineno);
+            }
+            coverage[at / 64] |= mask;
+            at += bits;
+        }
+        if (line_table_enabled) record_line_span(emit_address, chunk);
+        if (emit_address < window_start || emit_address + chunk > window_start + window_size) unmap_output();
+        uint8_t* destination = &image_at(emit_address);
+        if (bytes) { std::copy(bytes, bytes + chunk, destination); bytes += chunk; }
+        else std::fill(destination, destination + chunk, fill);
+        emit_address += chunk;
+        count -= chunk;
+    }
+}
+void Assembler::emit(const uint8_t* bytes, size_t count) { store(bytes, 0, count); }
+
+// Adds stored addresses to the line table, extending the last run when it continues it.
+void Assembler::record_line_span(uint16_t start, size_t count) {
+    uint32_t line = this->lineno + 1;
+    uint16_t depth = expansion_stack.size() + replay_depth;
+    if (!line_table.empty()) {
+        LineTableEntry& run = line_table.back();
+        if (run.line == line && run.depth == depth && run.last != 0xFFFF && run.last + 1 == start) { run.last += count; return; }
+    }
+    line_table.push_back({ start, static_cast<uint16_t>(start + count - 1), line, 0, depth });
+}
+
+// Puts the line table in address order (parallel pass 2 appends it slice by slice) and joins the
+// runs that meet there.
+void Assembler::sort_line_table() {
+    std::sort(line_table.begin(), line_table.end(), [](const LineTableEntry& a, const LineTableEntry& b) { return a.address < b.address; });
+    size_t kept = 0;
+    for (size_t i = 0; i < line_table.size(); ++i) {
+        if (kept > 0) {
+            LineTableEntry& run = line_table[kept - 1];
+            const LineTableEntry& next = line_table[i];
+            if (run.line == next.line && run.depth == next.depth && run.last != 0xFFFF && run.last + 1 == next.address) { run.last = next.last; continue; }
+        }
+        line_table[kept++] = line_table[i];
+    }
+    line_table.resize(kept);
 }
+void Assembler::emit_byte(uint8_t value) { store(&value, 0, 1); }
+void Assembler::emit_word(uint16_t value) { const uint8_t bytes[2] = { static_cast<uint8_t>(value & 0xFF), static_cast<uint8_t>(value >> 8) }; emit(bytes, 2); }
 
 // Adds a label and its current address to the symbol table.
-void Assembler::add_label() { if (symbol_table.count(label)) { report_error("duplicate label: \"" + label + "\"", this->lineno); } symbol_table[label] = address; cross_reference_data[label].push_back(-(this->lineno + 1));}
+void Assembler::add_label() { if (symbol_table.count(label)) { report_error("duplicate label: \"" + label + "\"", this->lineno); } symbol_table[label] = address; if (cross_reference) cross_reference_data[label].push_back(-(this->lineno + 1));}
 
 // Checks for the correct number of operands and reports an error if invalid.
 void Assembler::check_operands(bool valid, const std::string& mnemonic_name) { if (!valid) { report_error("invalid operands for mnemonic \"" + mnemonic_name + "\"", this->lineno); } }
 
 // Converts a string (hex, decimal, etc.) to a number.
-int Assembler::get_number(std::string input) const { trim(input); if (input.empty()) return 0; if (input.front() == '-') { return std::stoi(input, nullptr, 10); } char last = tolower(input.back()); int base = 10; if (last == 'h') { base = 16; input.pop_back(); } else if (last == 'q') { base = 8; input.pop_back(); } else if (last == 'b') { base = 2; input.pop_back(); } try { return std::stoul(input, nullptr, base); } catch (const std::exception&) { report_error("invalid number format: " + input, this->lineno); } return 0; }
+int Assembler::get_number(std::string input) const { trim(input); if (input.empty()) return 0; bool negative = input.front() == '-'; char last = negative ? 0 : tolower(input.back()); int base = 10; if (last == 'h') { base = 16; input.pop_back(); } else if (last == 'q') { base = 8; input.pop_back(); } else if (last == 'b') { base = 2; input.pop_back(); } try { if (negative) return std::stoi(input, nullptr, 10); return std::stoul(input, nullptr, base); } catch (const std::exception&) { report_error("invalid number format: " + input, this->lineno); } return 0; }
 
 // *** Expression Evaluation Engine (Recursive Descent Parser) ***
 int Assembler::register_offset8(std::string raw_register) { to_lower(raw_register); if (raw_register == "b") return 0; if (raw_register == "c") return 1; if (raw_register == "d") return 2; if (raw_register == "e") return 3; if (raw_register == "h") return 4; if (raw_register == "l") return 5; if (raw_register == "m") return 6; if (raw_register == "a") return 7; report_error("invalid 8-bit register \"" + raw_register + "\"", this->lineno); return -1; }
-int Assembler::register_offset16() { std::string op = operand1; to_lower(op); if (op == "b" || op == "bc") return 0x00; if (op == "d" || op == "de") return 0x10; if (op == "h" || op == "hl") return 0x20; if (op == "psw") { if (mnemonic == "push" || mnemonic == "pop") return 0x30; report_error("\"psw\" cannot be used with instruction \"" + mnemonic + "\"", this->lineno); } if (op == "sp") { if (mnemonic != "push" && mnemonic != "pop") return 0x30; report_error("\"sp\" cannot be used with instruction \"" + mnemonic + "\"", this->lineno); } report_error("invalid 16-bit register \"" + operand1 + "\" for instruction \"" + mnemonic + "\"", this->lineno); return -1; }
-void Assembler::immediate_operand(ImmediateType operand_type) { if (source_pass != 2) return; std::string operand = (mnemonic == "lxi" || mnemonic == "mvi") ? operand2 : operand1; int number = evaluate_expression(operand); if (operand_type == IMMEDIATE8) { output.push_back(number & 0xFF); } else { output.push_back(number & 0xFF); output.push_back((number >> 8) & 0xFF); } }
-void Assembler::address16(const std::string& operand) { if (source_pass != 2) return; uint16_t number = evaluate_expression(operand); output.push_back(number & 0xFF); output.push_back((number >> 8) & 0xFF); }
-bool Assembler::should_skip() const { for (bool condition : if_stack) { if (!condition) return true; } return false; }
+int Assembler::register_field(OperandClass operand_class, std::string op) { to_lower(op); if (operand_class == OperandClass::REG8) return register_offset8(op); if (operand_class == OperandClass::RST) { int vector = get_number(op); if (vector < 0 || vector > 7) report_error("invalid restart vector", this->lineno); return vector; } if (operand_class == OperandClass::PAIR_BD) { if (op == "b") return 0; if (op == "d") return 1; report_error("\"" + mnemonic + "\" only takes \"b\" or \"d\"", this->lineno); } if (op == "b" || op == "bc") return 0; if (op == "d" || op == "de") return 1; if (op == "h" || op == "hl") return 2; if (op == "psw") { if (operand_class == OperandClass::PAIR_PSW) return 3; report_error("\"psw\" cannot be used with instruction \"" + mnemonic + "\"", this->lineno); } if (op == "sp") { if (operand_class == OperandClass::PAIR) return 3; report_error("\"sp\" cannot be used with instruction \"" + mnemonic + "\"", this->lineno); } report_error("invalid 16-bit register \"" + op + "\" for instruction \"" + mnemonic + "\"", this->lineno); return -1; }
+void Assembler::address16(const std::string& operand) { if (source_pass != 2) return; emit_word(evaluate_expression(operand)); }
+bool Assembler::should_skip() const { return inactive_blocks > 0; }
 bool Assembler::evaluate_conditional(const std::string& expr) { const std::vector<std::pair<std::string, std::string>> ops = { {"ne", "!="}, {"eq", "="}, {"ge", ">="}, {"le", "<="}, {"gt", ">"}, {"lt", "<"} }; std::string op_str; size_t op_pos = std::string::npos; for (const auto& op_pair : ops) { if ((op_pos = expr.find(op_pair.first)) != std::string::npos) { op_str = op_pair.first; break; } if ((op_pos = expr.find(op_pair.second)) != std::string::npos) { op_str = op_pair.second; break; } } if (op_pos != std::string::npos) { std::string lhs_str = expr.substr(0, op_pos); std::string rhs_str = expr.substr(op_pos + op_str.length()); int lhs_val = evaluate_expression(lhs_str); int rhs_val = evaluate_expression(rhs_str); if (op_str == "eq" || op_str == "=") return lhs_val == rhs_val; if (op_str == "ne" || op_str == "!=") return lhs_val != rhs_val; if (op_str == "gt" || op_str == ">") return lhs_val > rhs_val; if (op_str == "lt" || op_str == "<") return lhs_val < rhs_val; if (op_str == "ge" || op_str == ">=") return lhs_val >= rhs_val; if (op_str == "le" || op_str == "<=") return lhs_val <= rhs_val; } else { return evaluate_expression(expr) != 0; } return false; }
 
 // --- Expression Evaluation Engine ---
@@ -338,114 +1631,28 @@ int Assembler::parse_expr_factor(std::string::const_iterator& it, std::string::c
 int Assembler::parse_expr_term(std::string::const_iterator& it, std::string::const_iterator end) { int result = parse_expr_factor(it, end); while (true) { auto current_pos = it; std::string op = get_token(it, end); to_lower(op); if (op != "*" && op != "/" && op != "and") { it = current_pos; break; } int rhs = parse_expr_factor(it, end); if (op == "*") result *= rhs; else if (op == "/") result /= rhs; else if (op == "and") result &= rhs; } return result; }
 int Assembler::evaluate_expression(std::string::const_iterator& it, std::string::const_iterator end) { int result = parse_expr_term(it, end); while (true) { auto current_pos = it; std::string op = get_token(it, end); to_lower(op); if (op != "+" && op != "-" && op != "or" && op != "xor") { it = current_pos; break; } int rhs = parse_expr_term(it, end); if (op == "+") result += rhs; else if (op == "-") result -= rhs; else if (op == "or") result |= rhs; else if (op == "xor") result ^= rhs; } return result; }
 int Assembler::evaluate_expression(const std::string& expr) { auto it = expr.begin(); auto end = expr.end(); return evaluate_expression(it, end); }
-int Assembler::evaluate_single_term(const std::string& term_str) { std::string term = term_str; trim(term); if (term.empty()) return 0; if (is_char_constant(term)) { return static_cast<uint8_t>(term[1]); } to_lower(term); if (term == "$") return this->address; if (term.rfind("low ", 0) == 0) { std::string label = term.substr(4); trim(label); if (symbol_table.count(label)) return symbol_table.at(label) & 0xFF; if (source_pass == 2) report_error("undefined label in LOW operator: " + label, this->lineno); return 0; } if (term.rfind("high ", 0) == 0) { std::string label = term.substr(5); trim(label); if (symbol_table.count(label)) return (symbol_table.at(label) >> 8) & 0xFF; if (source_pass == 2) report_error("undefined label in HIGH operator: " + label, this->lineno); return 0; } if (isdigit(term[0]) || (term.length() > 1 && term[0] == '-')) { return get_number(term); } if (symbol_table.count(term)) { cross_reference_data[term].push_back(this->lineno + 1); return symbol_table.at(term); } if (source_pass == 2) { report_error("undefined label in expression: " + term, this->lineno); } return 0; }
+int Assembler::evaluate_single_term(const std::string& term_str) { std::string term = term_str; trim(term); if (term.empty()) return 0; if (is_char_constant(term)) { return static_cast<uint8_t>(term[1]); } to_lower(term); if (term == "$") { constant_expression = false; return this->address; } if (term.rfind("low ", 0) == 0) { constant_expression = false; std::string label = term.substr(4); trim(label); if (symbol_table.count(label)) return symbol_table.at(label) & 0xFF; if (source_pass == 2) report_error("undefined label in LOW operator: " + label, this->lineno); return 0; } if (term.rfind("high ", 0) == 0) { constant_expression = false; std::string label = term.substr(5); trim(label); if (symbol_table.count(label)) return (symbol_table.at(label) >> 8) & 0xFF; if (source_pass == 2) report_error("undefined label in HIGH operator: " + label, this->lineno); return 0; } if (isdigit(term[0]) || (term.length() > 1 && term[0] == '-')) { return get_number(term); } if (!constant_symbols.count(term)) { constant_expression = false; } if (symbol_table.count(term)) { if (cross_reference) { cross_reference_data[term].push_back(this->lineno + 1); if (xref_capture) xref_capture->push_back(term); } return symbol_table.at(term); } if (source_pass == 2) { report_error("undefined label in expression: " + term, this->lineno); } return 0; }
 bool Assembler::is_quote_delimited(const std::string& s) const { if (s.length() < 2) return false; char first = s.front(); char last = s.back(); return (first == '"' && last == '"') || (first == '\'' && last == '\''); }
 bool Assembler::is_char_constant(const std::string& s) const { return s.length() == 3 && s.front() == '\'' && s.back() == '\''; }
 
-// --- Instruction & Directive Handlers ---
-void Assembler::nop() { check_operands(operand1.empty() && operand2.empty(), "nop"); pass_action(1, {0x00}); }
-void Assembler::lxi() { check_operands(!operand1.empty() && !operand2.empty(), "lxi"); uint8_t opcode = 0x01 + register_offset16(); pass_action(3, {opcode}); immediate_operand(IMMEDIATE16); }
-void Assembler::stax() { check_operands(!operand1.empty() && operand2.empty(), "stax"); std::string op = operand1; to_lower(op); if (op == "b") pass_action(1, {0x02}); else if (op == "d") pass_action(1, {0x12}); else report_error("\"stax\" only takes \"b\" or \"d\"", this->lineno); }
-void Assembler::inx() { check_operands(!operand1.empty() && operand2.empty(), "inx"); uint8_t opcode = 0x03 + register_offset16(); pass_action(1, {opcode}); }
-void Assembler::inr() { check_operands(!operand1.empty() && operand2.empty(), "inr"); uint8_t opcode = 0x04 + (register_offset8(operand1) << 3); pass_action(1, {opcode}); }
-void Assembler::dcr() { check_operands(!operand1.empty() && operand2.empty(), "dcr"); uint8_t opcode = 0x05 + (register_offset8(operand1) << 3); pass_action(1, {opcode}); }
-void Assembler::mvi() { check_operands(!operand1.empty() && !operand2.empty(), "mvi"); uint8_t opcode = 0x06 + (register_offset8(operand1) << 3); pass_action(2, {opcode}); immediate_operand(IMMEDIATE8); }
-void Assembler::rlc() { check_operands(operand1.empty() && operand2.empty(), "rlc"); pass_action(1, {0x07}); }
-void Assembler::dad() { check_operands(!operand1.empty() && operand2.empty(), "dad"); uint8_t opcode = 0x09 + register_offset16(); pass_action(1, {opcode}); }
-void Assembler::ldax() { check_operands(!operand1.empty() && operand2.empty(), "ldax"); std::string op = operand1; to_lower(op); if (op == "b") pass_action(1, {0x0A}); else if (op == "d") pass_action(1, {0x1A}); else report_error("\"ldax\" only takes \"b\" or \"d\"", this->lineno); }
-void Assembler::dcx() { check_operands(!operand1.empty() && operand2.empty(), "dcx"); uint8_t opcode = 0x0B + register_offset16(); pass_action(1, {opcode}); }
-void Assembler::rrc() { check_operands(operand1.empty() && operand2.empty(), "rrc"); pass_action(1, {0x0F}); }
-void Assembler::ral() { check_operands(operand1.empty() && operand2.empty(), "ral"); pass_action(1, {0x17}); }
-void Assembler::rar() { check_operands(operand1.empty() && operand2.empty(), "rar"); pass_action(1, {0x1F}); }
-void Assembler::shld() { check_operands(!operand1.empty() && operand2.empty(), "shld"); pass_action(3, {0x22}); address16(operand1); }
-void Assembler::daa() { check_operands(operand1.empty() && operand2.empty(), "daa"); pass_action(1, {0x27}); }
-void Assembler::lhld() { check_operands(!operand1.empty() && operand2.empty(), "lhld"); pass_action(3, {0x2A}); address16(operand1); }
-void Assembler::cma() { check_operands(operand1.empty() && operand2.empty(), "cma"); pass_action(1, {0x2F}); }
-void Assembler::sta() { check_operands(!operand1.empty() && operand2.empty(), "sta"); pass_action(3, {0x32}); address16(operand1); }
-void Assembler::stc() { check_operands(operand1.empty() && operand2.empty(), "stc"); pass_action(1, {0x37}); }
-void Assembler::lda() { check_operands(!operand1.empty() && operand2.empty(), "lda"); pass_action(3, {0x3A}); address16(operand1); }
-void Assembler::cmc() { check_operands(operand1.empty() && operand2.empty(), "cmc"); pass_action(1, {0x3F}); }
-void Assembler::mov() { check_operands(!operand1.empty() && !operand2.empty(), "mov"); uint8_t opcode = 0x40 + (register_offset8(operand1) << 3) + register_offset8(operand2); pass_action(1, {opcode}); }
-void Assembler::hlt() { check_operands(operand1.empty() && operand2.empty(), "hlt"); pass_action(1, {0x76}); }
-void Assembler::add() { check_operands(!operand1.empty() && operand2.empty(), "add"); uint8_t opcode = 0x80 + register_offset8(operand1); pass_action(1, {opcode}); }
-void Assembler::adc() { check_operands(!operand1.empty() && operand2.empty(), "adc"); uint8_t opcode = 0x88 + register_offset8(operand1); pass_action(1, {opcode}); }
-void Assembler::sub() { check_operands(!operand1.empty() && operand2.empty(), "sub"); uint8_t opcode = 0x90 + register_offset8(operand1); pass_action(1, {opcode}); }
-void Assembler::sbb() { check_operands(!operand1.empty() && operand2.empty(), "sbb"); uint8_t opcode = 0x98 + register_offset8(operand1); pass_action(1, {opcode}); }
-void Assembler::ana() { check_operands(!operand1.empty() && operand2.empty(), "ana"); uint8_t opcode = 0xA0 + register_offset8(operand1); pass_action(1, {opcode}); }
-void Assembler::xra() { check_operands(!operand1.empty() && operand2.empty(), "xra"); uint8_t opcode = 0xA8 + register_offset8(operand1); pass_action(1, {opcode}); }
-void Assembler::ora() { check_operands(!operand1.empty() && operand2.empty(), "ora"); uint8_t opcode = 0xB0 + register_offset8(operand1); pass_action(1, {opcode}); }
-void Assembler::cmp() { check_operands(!operand1.empty() && operand2.empty(), "cmp"); uint8_t opcode = 0xB8 + register_offset8(operand1); pass_action(1, {opcode}); }
-void Assembler::rnz() { check_operands(operand1.empty() && operand2.empty(), "rnz"); pass_action(1, {0xC0}); }
-void Assembler::pop() { check_operands(!operand1.empty() && operand2.empty(), "pop"); uint8_t opcode = 0xC1 + register_offset16(); pass_action(1, {opcode}); }
-void Assembler::jnz() { check_operands(!operand1.empty() && operand2.empty(), "jnz"); pass_action(3, {0xC2}); address16(operand1); }
-void Assembler::jmp() { check_operands(!operand1.empty() && operand2.empty(), "jmp"); pass_action(3, {0xC3}); address16(operand1); }
-void Assembler::cnz() { check_operands(!operand1.empty() && operand2.empty(), "cnz"); pass_action(3, {0xC4}); address16(operand1); }
-void Assembler::push() { check_operands(!operand1.empty() && operand2.empty(), "push"); uint8_t opcode = 0xC5 + register_offset16(); pass_action(1, {opcode}); }
-void Assembler::adi() { check_operands(!operand1.empty() && operand2.empty(), "adi"); pass_action(2, {0xC6}); immediate_operand(); }
-void Assembler::rst() { check_operands(!operand1.empty() && operand2.empty(), "rst"); int offset = get_number(operand1); if (offset >= 0 && offset <= 7) { uint8_t opcode = 0xC7 + (offset << 3); pass_action(1, {opcode}); } else { report_error("invalid restart vector", this->lineno); } }
-void Assembler::rz() { check_operands(operand1.empty() && operand2.empty(), "rz"); pass_action(1, {0xC8}); }
-void Assembler::ret() { check_operands(operand1.empty() && operand2.empty(), "ret"); pass_action(1, {0xC9}); }
-void Assembler::jz() { check_operands(!operand1.empty() && operand2.empty(), "jz"); pass_action(3, {0xCA}); address16(operand1); }
-void Assembler::cz() { check_operands(!operand1.empty() && operand2.empty(), "cz"); pass_action(3, {0xCC}); address16(operand1); }
-void Assembler::call() { check_operands(!operand1.empty() && operand2.empty(), "call"); pass_action(3, {0xCD}); address16(operand1); }
-void Assembler::aci() { check_operands(!operand1.empty() && operand2.empty(), "aci"); pass_action(2, {0xCE}); immediate_operand(); }
-void Assembler::rnc() { check_operands(operand1.empty() && operand2.empty(), "rnc"); pass_action(1, {0xD0}); }
-void Assembler::jnc() { check_operands(!operand1.empty() && operand2.empty(), "jnc"); pass_action(3, {0xD2}); address16(operand1); }
-void Assembler::i80_out() { check_operands(!operand1.empty() && operand2.empty(), "out"); pass_action(2, {0xD3}); immediate_operand(); }
-void Assembler::cnc() { check_operands(!operand1.empty() && operand2.empty(), "cnc"); pass_action(3, {0xD4}); address16(operand1); }
-void Assembler::sui() { check_operands(!operand1.empty() && operand2.empty(), "sui"); pass_action(2, {0xD6}); immediate_operand(); }
-void Assembler::rc() { check_operands(operand1.empty() && operand2.empty(), "rc"); pass_action(1, {0xD8}); }
-void Assembler::jc() { check_operands(!operand1.empty() && operand2.empty(), "jc"); pass_action(3, {0xDA}); address16(operand1); }
-void Assembler::i80_in() { check_operands(!operand1.empty() && operand2.empty(), "in"); pass_action(2, {0xDB}); immediate_operand(); }
-void Assembler::cc() { check_operands(!operand1.empty() && operand2.empty(), "cc"); pass_action(3, {0xDC}); address16(operand1); }
-void Assembler::sbi() { check_operands(!operand1.empty() && operand2.empty(), "sbi"); pass_action(2, {0xDE}); immediate_operand(); }
-void Assembler::rpo() { check_operands(operand1.empty() && operand2.empty(), "rpo"); pass_action(1, {0xE0}); }
-void Assembler::jpo() { check_operands(!operand1.empty() && operand2.empty(), "jpo"); pass_action(3, {0xE2}); address16(operand1); }
-void Assembler::xthl() { check_operands(operand1.empty() && operand2.empty(), "xthl"); pass_action(1, {0xE3}); }
-void Assembler::cpo() { check_operands(!operand1.empty() && operand2.empty(), "cpo"); pass_action(3, {0xE4}); address16(operand1); }
-void Assembler::ani() { check_operands(!operand1.empty() && operand2.empty(), "ani"); pass_action(2, {0xE6}); immediate_operand(); }
-void Assembler::rpe() { check_operands(operand1.empty() && operand2.empty(), "rpe"); pass_action(1, {0xE8}); }
-void Assembler::pchl() { check_operands(operand1.empty() && operand2.empty(), "pchl"); pass_action(1, {0xE9}); }
-void Assembler::jpe() { check_operands(!operand1.empty() && operand2.empty(), "jpe"); pass_action(3, {0xEA}); address16(operand1); }
-void Assembler::xchg() { check_operands(operand1.empty() && operand2.empty(), "xchg"); pass_action(1, {0xEB}); }
-void Assembler::cpe() { check_operands(!operand1.empty() && operand2.empty(), "cpe"); pass_action(3, {0xEC}); address16(operand1); }
-void Assembler::xri() { check_operands(!operand1.empty() && operand2.empty(), "xri"); pass_action(2, {0xEE}); immediate_operand(); }
-void Assembler::rp() { check_operands(operand1.empty() && operand2.empty(), "rp"); pass_action(1, {0xF0}); }
-void Assembler::jp() { check_operands(!operand1.empty() && operand2.empty(), "jp"); pass_action(3, {0xF2}); address16(operand1); }
-void Assembler::di() { check_operands(operand1.empty() && operand2.empty(), "di"); pass_action(1, {0xF3}); }
-void Assembler::cp() { check_operands(!operand1.empty() && operand2.empty(), "cp"); pass_action(3, {0xF4}); address16(operand1); }
-void Assembler::ori() { check_operands(!operand1.empty() && operand2.empty(), "ori"); pass_action(2, {0xF6}); immediate_operand(); }
-void Assembler::rm() { check_operands(operand1.empty() && operand2.empty(), "rm"); pass_action(1, {0xF8}); }
-void Assembler::sphl() { check_operands(operand1.empty() && operand2.empty(), "sphl"); pass_action(1, {0xF9}); }
-void Assembler::jm() { check_operands(!operand1.empty() && operand2.empty(), "jm"); pass_action(3, {0xFA}); address16(operand1); }
-void Assembler::ei() { check_operands(operand1.empty() && operand2.empty(), "ei"); pass_action(1, {0xFB}); }
-void Assembler::cm() { check_operands(!operand1.empty() && operand2.empty(), "cm"); pass_action(3, {0xFC}); address16(operand1); }
-void Assembler::cpi() { check_operands(!operand1.empty() && operand2.empty(), "cpi"); pass_action(2, {0xFE}); immediate_operand(); }
-void Assembler::db() { std::string all_operands = operand1; if (!operand2.empty()) { all_operands += "," + operand2; } check_operands(!all_operands.empty(), "db"); bool should_add_label_flag = true; std::vector<std::string> arguments = split_args(all_operands, ','); for (const auto& arg : arguments) { std::string temp_arg = arg; trim(temp_arg); if (temp_arg.length() > 2 && temp_arg.front() == '<' && temp_arg.back() == '>') { std::string inner_content = temp_arg.substr(1, temp_arg.length() - 2); std::vector<std::string> byte_args = split_args(inner_content, ','); for (const auto& byte_str : byte_args) { pass_action(1, {}, !label.empty() && should_add_label_flag); if (source_pass == 2) { uint8_t val = evaluate_expression(byte_str) & 0xFF; output.push_back(val); } should_add_label_flag = false; } } else if (is_quote_delimited(temp_arg)) { std::string str = temp_arg.substr(1, temp_arg.length() - 2); pass_action(str.length(), {}, !label.empty() && should_add_label_flag); if (source_pass == 2) { for(char c : str) output.push_back(c); } } else if (is_char_constant(temp_arg)) { pass_action(1, {}, !label.empty() && should_add_label_flag); if (source_pass == 2) { output.push_back(static_cast<uint8_t>(temp_arg[1])); } } else { pass_action(1, {}, !label.empty() && should_add_label_flag); if (source_pass == 2) { uint8_t val = evaluate_expression(temp_arg) & 0xFF; output.push_back(val); } } should_add_label_flag = false; } }
-void Assembler::dw() { std::string all_operands = operand1; if (!operand2.empty()) { all_operands += "," + operand2; } check_operands(!all_operands.empty(), "dw"); std::vector<std::string> arguments = split_args(all_operands, ','); for (const auto& arg : arguments) { std::string temp_arg = arg; trim(temp_arg); pass_action(2, {}); if (source_pass == 2) { address16(temp_arg); } } }
-void Assembler::ds() { check_operands(!operand1.empty(), "ds"); int size = evaluate_expression(operand1); if (size < 0) { report_error("DS size cannot be negative", this->lineno); } uint8_t fill_value = 0; if (!operand2.empty()) { fill_value = evaluate_expression(operand2); } if (source_pass == 2) { output.insert(output.end(), size, fill_value); } pass_action(size, {}); }
+// --- Directive Handlers ---
+void Assembler::db() { std::string all_operands = operand1; if (!operand2.empty()) { all_operands += "," + operand2; } check_operands(!all_operands.empty(), "db"); bool should_add_label_flag = true; std::vector<std::string> arguments = split_args(all_operands, ','); for (const auto& arg : arguments) { std::string temp_arg = arg; trim(temp_arg); if (temp_arg.length() > 2 && temp_arg.front() == '<' && temp_arg.back() == '>') { std::string inner_content = temp_arg.substr(1, temp_arg.length() - 2); std::vector<std::string> byte_args = split_args(inner_content, ','); for (const auto& byte_str : byte_args) { pass_action(1, !label.empty() && should_add_label_flag); if (source_pass == 2) { emit_byte(evaluate_expression(byte_str) & 0xFF); } should_add_label_flag = false; } } else if (is_quote_delimited(temp_arg)) { std::string str = temp_arg.substr(1, temp_arg.length() - 2); pass_action(str.length(), !label.empty() && should_add_label_flag); if (source_pass == 2) { emit(reinterpret_cast<const uint8_t*>(str.data()), str.length()); } } else if (is_char_constant(temp_arg)) { pass_action(1, !label.empty() && should_add_label_flag); if (source_pass == 2) { emit_byte(static_cast<uint8_t>(temp_arg[1])); } } else { pass_action(1, !label.empty() && should_add_label_flag); if (source_pass == 2) { emit_byte(evaluate_expression(temp_arg) & 0xFF); } } should_add_label_flag = false; } }
+void Assembler::dw() { std::string all_operands = operand1; if (!operand2.empty()) { all_operands += "," + operand2; } check_operands(!all_operands.empty(), "dw"); std::vector<std::string> arguments = split_args(all_operands, ','); for (const auto& arg : arguments) { std::string temp_arg = arg; trim(temp_arg); pass_action(2); address16(temp_arg); } }
+void Assembler::ds() { check_operands(!operand1.empty(), "ds"); int size = evaluate_expression(operand1); if (size < 0) { report_error("DS size cannot be negative", this->lineno); } uint8_t fill_value = 0; if (!operand2.empty()) { fill_value = evaluate_expression(operand2); } pass_action(size); if (source_pass == 2) { store(nullptr, fill_value, size); } }
 void Assembler::end() { check_operands(label.empty() && operand1.empty() && operand2.empty(), "end"); assembly_finished = true; }
-void Assembler::equ() { if (label.empty()) { report_error("missing 'equ' label", this->lineno); } check_operands(!operand1.empty() && operand2.empty(), "equ"); uint16_t value = evaluate_expression(operand1); if (source_pass == 1) { if (symbol_table.count(label)) { report_error("duplicate label: \"" + label + "\"", this->lineno); } symbol_table[label] = value; } }
-void Assembler::org() { check_operands(!operand1.empty() && label.empty() && operand2.empty(), "org"); uint16_t new_address = evaluate_expression(operand1); if (source_pass == 2) { if (new_address > address) { output.insert(output.end(), new_address - address, 0); } } address = new_address; }
-void Assembler::name() {} void Assembler::title() {} void Assembler::sim() { check_operands(operand1.empty() && operand2.empty(), "sim"); pass_action(1, {0x30}); } void Assembler::rim() { check_operands(operand1.empty() && operand2.empty(), "rim"); pass_action(1, {0x20}); }
+void Assembler::equ() { if (label.empty()) { report_error("missing 'equ' label", this->lineno); } check_operands(!operand1.empty() && operand2.empty(), "equ"); constant_expression = true; uint16_t value = evaluate_expression(operand1); if (source_pass == 1 && !defined_symbols.count(label)) { if (symbol_table.count(label)) { report_error("duplicate label: \"" + label + "\"", this->lineno); } symbol_table[label] = value; if (constant_expression) { constant_symbols.insert(label); } } }
+void Assembler::set() { if (label.empty()) { report_error("missing '" + mnemonic + "' label", this->lineno); } check_operands(!operand1.empty() && operand2.empty(), mnemonic); uint16_t value = evaluate_expression(operand1); if (symbol_table.count(label) && !redefinable_symbols.count(label)) { report_error("duplicate label: \"" + label + "\"", this->lineno); } symbol_table[label] = value; redefinable_symbols.insert(label); }
+void Assembler::org() { check_operands(!operand1.empty() && label.empty() && operand2.empty(), "org"); uint16_t new_address = evaluate_expression(operand1); address = new_address; }
+void Assembler::name() {} void Assembler::title() {}
+void Assembler::select_cpu() { check_operands(label.empty() && operand1.empty() && operand2.empty(), mnemonic); cpu = cpu_from_directive(mnemonic); }
 
-// Initializes the map that connects mnemonic strings to their handler functions.
+// Initializes the map that connects directive names to their handler functions.
+// Instructions are encoded from the instruction set tables instead.
 void Assembler::initialize_mnemonic_handlers() {
     mnemonic_handlers = {
-        {"nop", &Assembler::nop}, {"lxi", &Assembler::lxi}, {"stax", &Assembler::stax}, {"inx", &Assembler::inx}, {"inr", &Assembler::inr}, {"dcr", &Assembler::dcr},
-        {"mvi", &Assembler::mvi}, {"rlc", &Assembler::rlc}, {"dad", &Assembler::dad}, {"ldax", &Assembler::ldax},{"dcx", &Assembler::dcx}, {"rrc", &Assembler::rrc},
-        {"ral", &Assembler::ral}, {"rar", &Assembler::rar}, {"shld", &Assembler::shld}, {"daa", &Assembler::daa}, {"lhld", &Assembler::lhld},{"cma", &Assembler::cma},
-        {"sta", &Assembler::sta}, {"stc", &Assembler::stc}, {"lda", &Assembler::lda}, {"cmc", &Assembler::cmc}, {"mov", &Assembler::mov}, {"hlt", &Assembler::hlt},
-        {"add", &Assembler::add}, {"adc", &Assembler::adc}, {"sub", &Assembler::sub}, {"sbb", &Assembler::sbb}, {"ana", &Assembler::ana}, {"xra", &Assembler::xra},
-        {"ora", &Assembler::ora}, {"cmp", &Assembler::cmp}, {"rnz", &Assembler::rnz}, {"pop", &Assembler::pop}, {"jnz", &Assembler::jnz}, {"jmp", &Assembler::jmp},
-        {"cnz", &Assembler::cnz}, {"push", &Assembler::push},{"adi", &Assembler::adi}, {"rst", &Assembler::rst}, {"rz", &Assembler::rz},   {"ret", &Assembler::ret},
-        {"jz", &Assembler::jz},   {"cz", &Assembler::cz},   {"call", &Assembler::call}, {"aci", &Assembler::aci}, {"rnc", &Assembler::rnc}, {"jnc", &Assembler::jnc},
-        {"out", &Assembler::i80_out},{"cnc", &Assembler::cnc}, {"sui", &Assembler::sui}, {"rc", &Assembler::rc},   {"jc", &Assembler::jc},   {"in", &Assembler::i80_in},
-        {"cc", &Assembler::cc},   {"sbi", &Assembler::sbi}, {"jpe", &Assembler::jpe}, {"rpo", &Assembler::rpo}, {"jpo", &Assembler::jpo}, {"xthl", &Assembler::xthl},
-        {"cpo", &Assembler::cpo}, {"ani", &Assembler::ani}, {"rpe", &Assembler::rpe}, {"pchl", &Assembler::pchl},{"xchg", &Assembler::xchg},{"cpe", &Assembler::cpe},
-        {"xri", &Assembler::xri}, {"rp", &Assembler::rp},   {"jp", &Assembler::jp}, {"di", &Assembler::di},   {"cp", &Assembler::cp},   {"ori", &Assembler::ori},
-        {"rm", &Assembler::rm},   {"sphl", &Assembler::sphl},{"jm", &Assembler::jm}, {"ei", &Assembler::ei},   {"cm", &Assembler::cm},   {"cpi", &Assembler::cpi},
         {"db", &Assembler::db},   {"ds", &Assembler::ds},   {"dw", &Assembler::dw}, {"end", &Assembler::end}, {"equ", &Assembler::equ}, {"name", &Assembler::name},
-        {"org", &Assembler::org}, {"title", &Assembler::title}, {"sim", &Assembler::sim}, {"rim", &Assembler::rim}
+        {"set", &Assembler::set}, {"defl", &Assembler::set},
+        {"org", &Assembler::org}, {"title", &Assembler::title},
+        {".8080", &Assembler::select_cpu}, {".8085u", &Assembler::select_cpu}, {".z80", &Assembler::select_cpu}
     };
 }
\ No newline at end of file
@@ -0,0 +1,101 @@
+#include "line_table.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <tuple>
+
+namespace {
+
+const char MAGIC[4] = { 'A', 'Y', 'D', 'B' };
+const uint16_t VERSION = 1;
+const size_t HEADER_SIZE = 12;
+const size_t ENTRY_SIZE = 12;
+
+void put(std::string& out, uint32_t value, int bytes) {
+    for (int i = 0; i < bytes; ++i) out += static_cast<char>(value >> (i * 8) & 0xFF);
+}
+
+uint32_t get(const std::string& data, size_t at, int bytes) {
+    uint32_t value = 0;
+    for (int i = 0; i < bytes; ++i) value |= static_cast<uint32_t>(static_cast<uint8_t>(data[at + i])) << (i * 8);
+    return value;
+}
+
+bool line_order(const LineTableEntry& a, const LineTableEntry& b) {
+    return std::tie(a.file, a.line, a.address) < std::tie(b.file, b.line, b.address);
+}
+
+} // namespace
+
+std::string format_line_table(const std::vector<std::string>& files, const std::vector<LineTableEntry>& entries) {
+    std::string out(MAGIC, sizeof MAGIC);
+    put(out, VERSION, 2);
+    put(out, files.size(), 2);
+    put(out, entries.size(), 4);
+    for (const auto& file : files) {
+        put(out, file.size(), 2);
+        out += file;
+    }
+    for (const auto& entry : entries) {
+        put(out, entry.address, 2);
+        put(out, entry.last, 2);
+        put(out, entry.line, 4);
+        put(out, entry.file, 2);
+        put(out, entry.depth, 2);
+    }
+    std::vector<uint32_t> by_line(entries.size());
+    for (uint32_t i = 0; i < by_line.size(); ++i) by_line[i] = i;
+    std::sort(by_line.begin(), by_line.end(), [&](uint32_t a, uint32_t b) { return line_order(entries[a], entries[b]); });
+    for (uint32_t index : by_line) put(out, index, 4);
+    return out;
+}
+
+bool LineTable::load(const std::string& filename, std::string& error) {
+    std::ifstream infile(filename, std::ios::binary);
+    if (!infile) { error = "Cannot open line table " + filename; return false; }
+    std::stringstream data;
+    data << infile.rdbuf();
+    return parse(data.str(), error);
+}
+
+bool LineTable::parse(const std::string& data, std::string& error) {
+    file_names.clear();
+    by_address.clear();
+    by_line.clear();
+    if (data.size() < HEADER_SIZE || data.compare(0, sizeof MAGIC, MAGIC, sizeof MAGIC) != 0) { error = "not a line table"; return false; }
+    if (get(data, 4, 2) != VERSION) { error = "unsupported line table version"; return false; }
+    size_t file_count = get(data, 6, 2), entry_count = get(data, 8, 4);
+    size_t at = HEADER_SIZE;
+    for (size_t i = 0; i < file_count; ++i) {
+        if (at + 2 > data.size()) { error = "truncated line table"; return false; }
+        size_t length = get(data, at, 2);
+        if (at + 2 + length > data.size()) { error = "truncated line table"; return false; }
+        file_names.push_back(data.substr(at + 2, length));
+        at += 2 + length;
+    }
+    if (data.size() - at != static_cast<uint64_t>(entry_count) * (ENTRY_SIZE + 4)) { error = "truncated line table"; return false; }
+    for (size_t i = 0; i < entry_count; ++i, at += ENTRY_SIZE) {
+        by_address.push_back({ static_cast<uint16_t>(get(data, at, 2)), static_cast<uint16_t>(get(data, at + 2, 2)),
+                               get(data, at + 4, 4), static_cast<uint16_t>(get(data, at + 8, 2)), static_cast<uint16_t>(get(data, at + 10, 2)) });
+    }
+    for (size_t i = 0; i < entry_count; ++i, at += 4) {
+        by_line.push_back(get(data, at, 4));
+        if (by_line.back() >= entry_count) { error = "corrupt line table"; return false; }
+    }
+    return true;
+}
+
+const LineTableEntry* LineTable::find_address(uint16_t address) const {
+    auto after = std::upper_bound(by_address.begin(), by_address.end(), address, [](uint16_t value, const LineTableEntry& entry) { return value < entry.address; });
+    if (after == by_address.begin()) return nullptr;
+    const LineTableEntry& entry = *(after - 1);
+    return address <= entry.last ? &entry : nullptr;
+}
+
+std::vector<const LineTableEntry*> LineTable::find_line(uint16_t file, uint32_t line) const {
+    LineTableEntry key = { 0, 0, line, file, 0 };
+    auto first = std::lower_bound(by_line.begin(), by_line.end(), key, [&](uint32_t index, const LineTableEntry& value) { return line_order(by_address[index], value); });
+    std::vector<const LineTableEntry*> found;
+    for (auto it = first; it != by_line.end() && by_address[*it].file == file && by_address[*it].line == line; ++it) found.push_back(&by_address[*it]);
+    return found;
+}
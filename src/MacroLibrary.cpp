@@ -0,0 +1,186 @@
+#include "macrolib.h"
+#include <fstream>
+#include <vector>
+
+#ifdef _WIN32
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// --- .mlb File Layout ---
+// All integers are little-endian.
+//   header:   "AYML", u16 version, u16 reserved, u32 string count, u32 macro count, u32 equate count
+//   strings:  u32 length + bytes, for every distinct name and literal text (interned)
+//   macros:   u32 name, u32 n + n param names, u32 n + n local names,
+//             u32 line count, per line: u32 n + n segments of (u8 kind, u32 string id or slot)
+//   equates:  u32 name, u16 value
+
+namespace {
+
+// Collects the bytes of a library file, interning every string it references.
+class LibraryWriter {
+public:
+    std::vector<uint8_t> bytes;
+
+    void u8(uint8_t v) { bytes.push_back(v); }
+    void u16(uint16_t v) { u8(v & 0xFF); u8(v >> 8); }
+    void u32(uint32_t v) { u16(v & 0xFFFF); u16(v >> 16); }
+    void str(const std::string& s) { u32(intern(s)); }
+
+    uint32_t intern(const std::string& s) {
+        auto found = string_ids.find(s);
+        if (found != string_ids.end()) return found->second;
+        uint32_t id = strings.size();
+        string_ids[s] = id;
+        strings.push_back(s);
+        return id;
+    }
+
+    // Assembles the final file: header, string table, then the already-written body.
+    std::vector<uint8_t> finish(uint32_t macro_count, uint32_t equate_count) {
+        LibraryWriter head;
+        for (char c : std::string("AYML")) head.u8(c);
+        head.u16(MACRO_LIBRARY_VERSION);
+        head.u16(0);
+        head.u32(strings.size());
+        head.u32(macro_count);
+        head.u32(equate_count);
+        for (const auto& s : strings) {
+            head.u32(s.length());
+            head.bytes.insert(head.bytes.end(), s.begin(), s.end());
+        }
+        head.bytes.insert(head.bytes.end(), bytes.begin(), bytes.end());
+        return head.bytes;
+    }
+
+private:
+    std::map<std::string, uint32_t> string_ids;
+    std::vector<std::string> strings;
+};
+
+// Bounds-checked cursor over the mapped file.
+class LibraryReader {
+public:
+    LibraryReader(const uint8_t* data, size_t size) : data(data), size(size) {}
+    bool ok = true;
+
+    uint8_t u8() { if (pos + 1 > size) { ok = false; return 0; } return data[pos++]; }
+    uint16_t u16() { uint16_t lo = u8(); return lo | (u8() << 8); }
+    uint32_t u32() { uint32_t lo = u16(); return lo | (static_cast<uint32_t>(u16()) << 16); }
+    std::string raw(size_t length) {
+        if (pos + length > size) { ok = false; return ""; }
+        std::string s(reinterpret_cast<const char*>(data + pos), length);
+        pos += length;
+        return s;
+    }
+    const std::string& str(const std::vector<std::string>& strings) {
+        static const std::string empty;
+        uint32_t id = u32();
+        if (id >= strings.size()) { ok = false; return empty; }
+        return strings[id];
+    }
+
+private:
+    const uint8_t* data;
+    size_t size;
+    size_t pos = 0;
+};
+
+// Decodes a whole library image. Returns false on a malformed or foreign file.
+bool decode_library(const uint8_t* data, size_t size, MacroLibrary& library, std::string& error) {
+    LibraryReader in(data, size);
+    if (in.raw(4) != "AYML") { error = "not a macro library"; return false; }
+    uint16_t version = in.u16();
+    if (version != MACRO_LIBRARY_VERSION) { error = "unsupported macro library version " + std::to_string(version); return false; }
+    in.u16();
+    uint32_t string_count = in.u32(), macro_count = in.u32(), equate_count = in.u32();
+    if (!in.ok || string_count > size) { error = "truncated macro library"; return false; }
+
+    std::vector<std::string> strings(string_count);
+    for (auto& s : strings) s = in.raw(in.u32());
+
+    bool corrupt = false;
+    for (uint32_t m = 0; m < macro_count && in.ok && !corrupt; ++m) {
+        Macro macro;
+        macro.name = in.str(strings);
+        for (uint32_t n = in.u32(); n > 0 && in.ok; --n) macro.params.push_back(in.str(strings));
+        for (uint32_t n = in.u32(); n > 0 && in.ok; --n) macro.locals.push_back(in.str(strings));
+        for (uint32_t lines = in.u32(); lines > 0 && in.ok; --lines) {
+            std::vector<MacroSegment> segments;
+            for (uint32_t n = in.u32(); n > 0 && in.ok && !corrupt; --n) {
+                uint8_t kind = in.u8();
+                if (kind == MacroSegment::TEXT) { segments.push_back({ MacroSegment::TEXT, in.str(strings), -1 }); continue; }
+                if (kind != MacroSegment::PARAM && kind != MacroSegment::LOCAL) { in.ok = false; continue; }
+                // Slots index the macro's own parameters or LOCAL names; expansion trusts them.
+                uint32_t slot = in.u32();
+                if (slot & 0x80000000u || slot >= (kind == MacroSegment::PARAM ? macro.params.size() : macro.locals.size())) corrupt = true;
+                segments.push_back({ static_cast<MacroSegment::Kind>(kind), "", static_cast<int>(slot) });
+            }
+            macro.template_lines.push_back(segments);
+        }
+        library.macros[macro.name] = macro;
+    }
+    if (corrupt) { error = "corrupt macro library"; return false; }
+    for (uint32_t e = 0; e < equate_count && in.ok; ++e) {
+        const std::string& name = in.str(strings);
+        library.equates[name] = in.u16();
+    }
+    if (!in.ok) { error = "truncated macro library"; return false; }
+    return true;
+}
+
+} // namespace
+
+bool write_macro_library(const std::string& filename, const MacroLibrary& library) {
+    LibraryWriter out;
+    for (const auto& pair : library.macros) {
+        const Macro& macro = pair.second;
+        out.str(macro.name);
+        out.u32(macro.params.size());
+        for (const auto& param : macro.params) out.str(param);
+        out.u32(macro.locals.size());
+        for (const auto& local : macro.locals) out.str(local);
+        out.u32(macro.template_lines.size());
+        for (const auto& line : macro.template_lines) {
+            out.u32(line.size());
+            for (const auto& segment : line) {
+                out.u8(segment.kind);
+                if (segment.kind == MacroSegment::TEXT) out.str(segment.text); else out.u32(segment.slot);
+            }
+        }
+    }
+    for (const auto& pair : library.equates) {
+        out.str(pair.first);
+        out.u16(pair.second);
+    }
+    std::vector<uint8_t> image = out.finish(library.macros.size(), library.equates.size());
+
+    std::ofstream outfile(filename, std::ios::binary);
+    if (!outfile) return false;
+    outfile.write(reinterpret_cast<const char*>(image.data()), image.size());
+    return static_cast<bool>(outfile);
+}
+
+bool load_macro_library(const std::string& filename, MacroLibrary& library, std::string& error) {
+#ifdef _WIN32
+    std::ifstream infile(filename, std::ios::binary);
+    if (!infile) { error = "cannot open macro library " + filename; return false; }
+    std::vector<uint8_t> image((std::istreambuf_iterator<char>(infile)), std::istreambuf_iterator<char>());
+    return decode_library(image.data(), image.size(), library, error);
+#else
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) { error = "cannot open macro library " + filename; return false; }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) { close(fd); error = "cannot read macro library " + filename; return false; }
+    void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) { error = "cannot map macro library " + filename; return false; }
+    bool ok = decode_library(static_cast<const uint8_t*>(mapping), info.st_size, library, error);
+    munmap(mapping, info.st_size);
+    return ok;
+#endif
+}
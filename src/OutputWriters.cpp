@@ -0,0 +1,224 @@
+#include "output_writers.h"
+#include <fstream>
+#include <algorithm>
+#include <cstdio>
+#if __has_include(<sys/mman.h>)
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define HAVE_MMAP 1
+#endif
+
+namespace {
+
+// Data bytes per HEX or S-record line.
+const uint32_t RECORD_BYTES = 16;
+
+// An IPS record: a 3-byte offset and a 2-byte size ahead of its data, which is at most 64 KiB - 1.
+const uint32_t IPS_RECORD_OVERHEAD = 5;
+const uint32_t IPS_MAX_RECORD = 0xFFFF;
+
+// The two uppercase hex digits of every byte value, built at compile time.
+struct HexTable {
+    char digits[256][2];
+    constexpr HexTable() : digits() {
+        for (int i = 0; i < 256; ++i) {
+            digits[i][0] = "0123456789ABCDEF"[i >> 4];
+            digits[i][1] = "0123456789ABCDEF"[i & 15];
+        }
+    }
+};
+constexpr HexTable HEX_TABLE;
+
+// Builds one text record: bytes are appended as hex and summed for the checksum.
+class RecordBuilder {
+public:
+    explicit RecordBuilder(std::string& text) : text(text) {}
+
+    void start(const char* mark) { text += mark; sum = 0; }
+    void byte(uint8_t value) { text.append(HEX_TABLE.digits[value], 2); sum += value; }
+    void word(uint16_t value) { byte(value >> 8); byte(value & 0xFF); }
+    void bytes(const uint8_t* data, size_t count) { for (size_t i = 0; i < count; ++i) byte(data[i]); }
+    uint8_t checksum() const { return sum; }
+    void finish(uint8_t checksum) { text.append(HEX_TABLE.digits[checksum], 2); text += '\n'; }
+
+private:
+    std::string& text;
+    uint8_t sum = 0;
+};
+
+// Calls record(address, data, count) for each 16-byte slice of the written ranges.
+template <typename Record>
+void for_each_record(const std::vector<uint8_t>& output, uint16_t origin, const std::vector<AddressRange>& ranges, Record record) {
+    for (const auto& range : ranges) {
+        size_t base = range.start - origin;
+        for (uint32_t offset = 0; offset < range.size; offset += RECORD_BYTES) {
+            uint32_t count = std::min(RECORD_BYTES, range.size - offset);
+            record(static_cast<uint16_t>(range.start + offset), output.data() + base + offset, count);
+        }
+    }
+}
+
+// Characters needed for the records of the ranges, given the per-record overhead.
+size_t text_size(const std::vector<AddressRange>& ranges, size_t overhead) {
+    size_t size = 64;
+    for (const auto& range : ranges) size += range.size * 2 + (range.size + RECORD_BYTES - 1) / RECORD_BYTES * overhead;
+    return size;
+}
+
+} // namespace
+
+bool parse_output_format(const std::string& name, OutputFormat& format) {
+    if (name == "bin") format = OutputFormat::BINARY;
+    else if (name == "ihex") format = OutputFormat::INTEL_HEX;
+    else if (name == "srec") format = OutputFormat::SREC;
+    else if (name == "sfx") format = OutputFormat::SELF_EXTRACTING;
+    else return false;
+    return true;
+}
+
+const char* output_extension(OutputFormat format) {
+    switch (format) {
+        case OutputFormat::INTEL_HEX: return ".hex";
+        case OutputFormat::SREC:      return ".s19";
+        default:                      return ".com";
+    }
+}
+
+// Record layout: ":" count, address, type 00, data, two's complement checksum.
+std::string format_intel_hex(const std::vector<uint8_t>& output, uint16_t origin, const std::vector<AddressRange>& ranges) {
+    std::string text;
+    text.reserve(text_size(ranges, 12));
+    RecordBuilder record(text);
+    for_each_record(output, origin, ranges, [&](uint16_t address, const uint8_t* data, uint32_t count) {
+        record.start(":");
+        record.byte(count);
+        record.word(address);
+        record.byte(0x00);
+        record.bytes(data, count);
+        record.finish(-record.checksum());
+    });
+    text += ":00000001FF\n";
+    return text;
+}
+
+// Record layout: "S" type, count (of the address, data and checksum bytes), address, data,
+// one's complement checksum.
+std::string format_srec(const std::vector<uint8_t>& output, uint16_t origin, const std::vector<AddressRange>& ranges) {
+    std::string text;
+    text.reserve(text_size(ranges, 11));
+    RecordBuilder record(text);
+    record.start("S0");
+    record.byte(3);
+    record.word(0);
+    record.finish(~record.checksum());
+    uint32_t records = 0;
+    for_each_record(output, origin, ranges, [&](uint16_t address, const uint8_t* data, uint32_t count) {
+        record.start("S1");
+        record.byte(count + 3);
+        record.word(address);
+        record.bytes(data, count);
+        record.finish(~record.checksum());
+        records++;
+    });
+    if (records <= 0xFFFF) {
+        record.start("S5");
+        record.byte(3);
+        record.word(records);
+        record.finish(~record.checksum());
+    }
+    record.start("S9");
+    record.byte(3);
+    record.word(0);
+    record.finish(~record.checksum());
+    return text;
+}
+
+std::vector<PatchRange> diff_images(const std::vector<uint8_t>& base, const std::vector<uint8_t>& image, uint16_t origin, uint32_t sector) {
+    auto differs = [&](uint32_t at) { return at >= base.size() || base[at] != image[at]; };
+    std::vector<PatchRange> ranges;
+    uint32_t size = image.size();
+    if (sector > 0) {
+        for (uint32_t start = 0, end; start < size; start = end) {
+            end = std::min<uint32_t>(size, start + sector - (origin + start) % sector);
+            uint32_t at = start;
+            while (at < end && !differs(at)) ++at;
+            if (at == end) continue;
+            if (!ranges.empty() && ranges.back().offset + ranges.back().size == start) ranges.back().size += end - start;
+            else ranges.push_back({ start, end - start });
+        }
+        return ranges;
+    }
+    for (uint32_t at = 0; at < size; ++at) {
+        if (!differs(at)) continue;
+        uint32_t end = at + 1;
+        while (end < size && differs(end)) ++end;
+        // Rewriting a few unchanged bytes is cheaper than starting another record.
+        if (!ranges.empty() && at - (ranges.back().offset + ranges.back().size) <= IPS_RECORD_OVERHEAD) ranges.back().size = end - ranges.back().offset;
+        else ranges.push_back({ at, end - at });
+        at = end;
+    }
+    return ranges;
+}
+
+std::string format_ips(const std::vector<uint8_t>& base, const std::vector<uint8_t>& image, const std::vector<PatchRange>& ranges) {
+    std::string patch = "PATCH";
+    auto put = [&](uint32_t value, int bytes) { while (bytes--) patch += static_cast<char>(value >> (bytes * 8) & 0xFF); };
+    for (const auto& range : ranges) {
+        for (uint32_t done = 0; done < range.size;) {
+            uint32_t count = std::min(IPS_MAX_RECORD, range.size - done);
+            put(range.offset + done, 3);
+            put(count, 2);
+            patch.append(reinterpret_cast<const char*>(image.data()) + range.offset + done, count);
+            done += count;
+        }
+    }
+    patch += "EOF";
+    if (image.size() < base.size()) put(image.size(), 3);
+    return patch;
+}
+
+std::string format_program(const Assembler& assembler, OutputFormat format) {
+    const std::vector<uint8_t>& output = assembler.getOutput();
+    if (format == OutputFormat::INTEL_HEX) return format_intel_hex(output, assembler.getOutputOrigin(), assembler.getOutputRanges());
+    if (format == OutputFormat::SREC) return format_srec(output, assembler.getOutputOrigin(), assembler.getOutputRanges());
+    return std::string(output.begin(), output.end());
+}
+
+MappedOutput::MappedOutput(const std::string& filename) : filename(filename) {}
+
+#if defined(HAVE_MMAP) && defined(O_TMPFILE)
+MappedOutput::~MappedOutput() {
+    if (mapping) munmap(mapping, mapped_size);
+    if (fd >= 0) close(fd);
+}
+
+uint8_t* MappedOutput::map(size_t size) {
+    if (fd >= 0 || size == 0) return nullptr;
+    size_t last_slash = filename.find_last_of('/');
+    std::string directory = last_slash == std::string::npos ? "." : filename.substr(0, last_slash + 1);
+    fd = open(directory.c_str(), O_TMPFILE | O_RDWR, 0644);
+    if (fd < 0) return nullptr;
+    void* memory = ftruncate(fd, size) == 0 ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    if (memory == MAP_FAILED) { close(fd); fd = -1; return nullptr; }
+    mapping = memory;
+    mapped_size = size;
+    return static_cast<uint8_t*>(mapping);
+}
+
+// The unnamed file is linked under a temporary name through /proc (linking it by descriptor needs
+// privileges), then renamed over the target in one step.
+bool MappedOutput::commit(size_t size) {
+    if (fd < 0 || ftruncate(fd, size) != 0) return false;
+    std::string temporary = filename + ".tmp";
+    std::string descriptor = "/proc/self/fd/" + std::to_string(fd);
+    unlink(temporary.c_str());
+    if (linkat(AT_FDCWD, descriptor.c_str(), AT_FDCWD, temporary.c_str(), AT_SYMLINK_FOLLOW) != 0) return false;
+    if (rename(temporary.c_str(), filename.c_str()) != 0) { unlink(temporary.c_str()); return false; }
+    return true;
+}
+#else
+MappedOutput::~MappedOutput() {}
+uint8_t* MappedOutput::map(size_t) { return nullptr; }
+bool MappedOutput::commit(size_t) { return false; }
+#endif
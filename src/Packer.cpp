@@ -0,0 +1,236 @@
+#include "packer.h"
+#include <algorithm>
+
+namespace {
+
+const size_t MIN_MATCH = 3;         // Shortest copy a token can encode.
+const size_t MIN_USEFUL_MATCH = 4;  // A 3-byte copy is never smaller than its literals.
+const size_t MAX_MATCH = 127 + MIN_MATCH;
+const size_t MAX_LITERALS = 127;
+const size_t MAX_DISTANCE = 0xFFFF;
+const size_t HASH_SIZE = 1 << 15;
+const int MAX_CHAIN = 4096;         // Candidates tried per position; images are at most 64 KiB.
+
+struct Match {
+    size_t length = 0;
+    size_t distance = 0;
+};
+
+// Finds earlier occurrences of the bytes at a position through chains of positions that
+// share the hash of their first three bytes.
+class MatchFinder {
+public:
+    explicit MatchFinder(const std::vector<uint8_t>& data) : data(data), head(HASH_SIZE, -1), prev(data.size(), -1) {}
+
+    void insert(size_t at) {
+        if (at + MIN_MATCH > data.size()) return;
+        size_t bucket = hash(at);
+        prev[at] = head[bucket];
+        head[bucket] = static_cast<int32_t>(at);
+    }
+
+    // The longest match for the bytes at `at` among the positions inserted so far.
+    Match longest(size_t at) const {
+        Match best;
+        size_t limit = std::min(MAX_MATCH, data.size() - at);
+        if (limit < MIN_MATCH) return best;
+        int chain = MAX_CHAIN;
+        for (int32_t candidate = head[hash(at)]; candidate >= 0 && chain-- > 0; candidate = prev[candidate]) {
+            size_t distance = at - candidate;
+            if (distance > MAX_DISTANCE) break;
+            if (data[candidate + best.length] != data[at + best.length]) continue;
+            size_t length = 0;
+            while (length < limit && data[candidate + length] == data[at + length]) ++length;
+            if (length > best.length) {
+                best.length = length;
+                best.distance = distance;
+                if (length == limit) break;
+            }
+        }
+        return best;
+    }
+
+private:
+    size_t hash(size_t at) const { return ((data[at] << 10) ^ (data[at + 1] << 5) ^ data[at + 2]) & (HASH_SIZE - 1); }
+
+    const std::vector<uint8_t>& data;
+    std::vector<int32_t> head;
+    std::vector<int32_t> prev;
+};
+
+// 8080 opcodes of the stub.
+enum Opcode : uint8_t {
+    LXI_B = 0x01, DCR_B = 0x05, DCX_B = 0x0B, LXI_D = 0x11, STAX_D = 0x12, INX_D = 0x13, DAD_D = 0x19, DCX_D = 0x1B,
+    LXI_H = 0x21, SHLD = 0x22, INX_H = 0x23, LHLD = 0x2A, DCX_H = 0x2B, MOV_B_A = 0x47, MOV_C_M = 0x4E, MOV_H_A = 0x67,
+    MOV_L_C = 0x69, MOV_A_B = 0x78, MOV_A_M = 0x7E, ORA_C = 0xB1, ORA_A = 0xB7, JNZ = 0xC2, JMP = 0xC3, ADI = 0xC6,
+    JZ = 0xCA, ANI = 0xE6, JM = 0xFA
+};
+
+// Appends stub code, keeping track of the address it will run at.
+class StubWriter {
+public:
+    StubWriter(std::vector<uint8_t>& code, uint16_t base) : code(code), base(base), start(code.size()) {}
+    uint16_t here() const { return base + (code.size() - start); }
+    void op(Opcode opcode) { code.push_back(opcode); }
+    void op(Opcode opcode, uint8_t value) { code.push_back(opcode); code.push_back(value); }
+    void op16(Opcode opcode, uint16_t value) { code.push_back(opcode); code.push_back(value & 0xFF); code.push_back(value >> 8); }
+
+private:
+    std::vector<uint8_t>& code;
+    uint16_t base;
+    size_t start;
+};
+
+const uint16_t LOAD_ADDRESS = 0x100;    // Where CP/M loads a .com.
+const uint16_t MOVER_SIZE = 22;
+const uint16_t DECOMPRESSOR_SIZE = 58;  // Code and the saved input pointer, ahead of the stream.
+
+// Copies the decompressor and stream, `size` bytes at `source`, up to `high` and runs it there.
+// The copy goes from the top down, because `high` may overlap the end of the source.
+// 48 T-states a byte. Returns false if the code is not MOVER_SIZE bytes long.
+bool write_mover(std::vector<uint8_t>& file, uint16_t source, uint16_t high, uint16_t size) {
+    StubWriter stub(file, LOAD_ADDRESS);
+    stub.op16(LXI_H, source + size - 1);
+    stub.op16(LXI_D, high + size - 1);
+    stub.op16(LXI_B, size);
+    uint16_t move = stub.here();
+    stub.op(MOV_A_M);
+    stub.op(STAX_D);
+    stub.op(DCX_H);
+    stub.op(DCX_D);
+    stub.op(DCX_B);
+    stub.op(MOV_A_B);
+    stub.op(ORA_C);
+    stub.op16(JNZ, move);
+    stub.op16(JMP, high);
+    return stub.here() == LOAD_ADDRESS + MOVER_SIZE;
+}
+
+// Unpacks the stream that follows it to `origin`, then jumps there. HL reads the stream and DE
+// writes the program; a copy adds the negated distance to DE and parks HL in memory rather than
+// on the stack, which may lie inside the program being unpacked. Both inner loops take 39
+// T-states a byte. The forward jump targets are fixed offsets; returns false if the code does not
+// put its labels there or is not DECOMPRESSOR_SIZE bytes long.
+bool write_decompressor(std::vector<uint8_t>& file, uint16_t high, uint16_t origin) {
+    const uint16_t next = high + 6, match = high + 27, saved = high + 56;
+    StubWriter stub(file, high);
+    bool laid_out = true;
+    stub.op16(LXI_H, high + DECOMPRESSOR_SIZE);
+    stub.op16(LXI_D, origin);
+    laid_out = laid_out && stub.here() == next;
+    stub.op(MOV_A_M);               // next: token
+    stub.op(INX_H);
+    stub.op(ORA_A);
+    stub.op16(JZ, origin);
+    stub.op16(JM, match);
+    stub.op(MOV_B_A);               // literals
+    uint16_t literal = stub.here();
+    stub.op(MOV_A_M);
+    stub.op(STAX_D);
+    stub.op(INX_H);
+    stub.op(INX_D);
+    stub.op(DCR_B);
+    stub.op16(JNZ, literal);
+    stub.op16(JMP, next);
+    laid_out = laid_out && stub.here() == match;
+    stub.op(ANI, 0x7F);             // match: length
+    stub.op(ADI, MIN_MATCH);
+    stub.op(MOV_B_A);
+    stub.op(MOV_C_M);               // negated distance
+    stub.op(INX_H);
+    stub.op(MOV_A_M);
+    stub.op(INX_H);
+    stub.op16(SHLD, saved);
+    stub.op(MOV_H_A);
+    stub.op(MOV_L_C);
+    stub.op(DAD_D);
+    uint16_t copy = stub.here();
+    stub.op(MOV_A_M);
+    stub.op(STAX_D);
+    stub.op(INX_H);
+    stub.op(INX_D);
+    stub.op(DCR_B);
+    stub.op16(JNZ, copy);
+    stub.op16(LHLD, saved);
+    stub.op16(JMP, next);
+    laid_out = laid_out && stub.here() == saved;
+    file.push_back(0);              // saved
+    file.push_back(0);
+    return laid_out && stub.here() == high + DECOMPRESSOR_SIZE;
+}
+
+// T-states of the decompressor for a stream, token by token.
+uint64_t decompression_states(const std::vector<uint8_t>& stream) {
+    const uint64_t SETUP = 20, TOKEN = 26 + 10, LITERALS = 15, MATCH = 105, PER_BYTE = 39;
+    uint64_t states = SETUP;
+    for (size_t at = 0; at < stream.size();) {
+        uint8_t token = stream[at++];
+        if (token == 0) return states + 26;
+        states += TOKEN;
+        if (token < 0x80) {
+            states += LITERALS + PER_BYTE * token;
+            at += token;
+        } else {
+            states += MATCH + PER_BYTE * ((token & 0x7F) + MIN_MATCH);
+            at += 2;
+        }
+    }
+    return states;
+}
+
+} // namespace
+
+// Greedy parsing with one step of lazy evaluation: a match is put off for a literal when the
+// next position has a longer one.
+std::vector<uint8_t> lz_compress(const std::vector<uint8_t>& data) {
+    std::vector<uint8_t> stream;
+    MatchFinder finder(data);
+    size_t literal_start = 0;
+    auto flush_literals = [&](size_t end) {
+        while (literal_start < end) {
+            size_t count = std::min(MAX_LITERALS, end - literal_start);
+            stream.push_back(count);
+            stream.insert(stream.end(), data.begin() + literal_start, data.begin() + literal_start + count);
+            literal_start += count;
+        }
+    };
+    for (size_t at = 0; at < data.size();) {
+        Match match = finder.longest(at);
+        finder.insert(at);
+        if (match.length < MIN_USEFUL_MATCH || (at + 1 < data.size() && finder.longest(at + 1).length > match.length)) {
+            ++at;
+            continue;
+        }
+        flush_literals(at);
+        uint16_t negated = -static_cast<uint16_t>(match.distance);
+        stream.push_back(0x80 | (match.length - MIN_MATCH));
+        stream.push_back(negated & 0xFF);
+        stream.push_back(negated >> 8);
+        for (size_t i = 1; i < match.length; ++i) finder.insert(at + i);
+        at += match.length;
+        literal_start = at;
+    }
+    flush_literals(data.size());
+    stream.push_back(0);
+    return stream;
+}
+
+bool pack_self_extracting(const std::vector<uint8_t>& image, uint16_t origin, SelfExtractingImage& packed, std::string& error) {
+    std::vector<uint8_t> stream = lz_compress(image);
+    uint32_t block = DECOMPRESSOR_SIZE + stream.size();
+    uint32_t source = LOAD_ADDRESS + MOVER_SIZE;
+    uint32_t high = std::max<uint32_t>(origin + image.size(), source);
+    if (high + block > 0x10000) {
+        error = "self-extracting image does not fit: the packed program would have to run above FFFFH";
+        return false;
+    }
+    packed.file.clear();
+    if (!write_mover(packed.file, source, high, block) || !write_decompressor(packed.file, high, origin)) {
+        error = "internal error: the self-extracting stub does not match its layout";
+        return false;
+    }
+    packed.file.insert(packed.file.end(), stream.begin(), stream.end());
+    packed.high = high;
+    packed.states = 30 + 48 * static_cast<uint64_t>(block) + 10 + decompression_states(stream);
+    return true;
+}
@@ -5,23 +5,76 @@
 #include <vector>
 #include <string>
 #include "Assembler.h"
+#include "macrolib.h"
+#include "parallel.h"
+#include "output_writers.h"
+#include "artifact_writer.h"
+#include "packer.h"
 #include <algorithm>
 #include <iomanip>
+#include <cstdlib>
+#include <cctype>
+#include <sstream>
+#include <memory>
 
 // Added for due to updates 9-15-25 ay
 void to_lower(std::string& sVal);
-void write_cross_reference_file(const std::string& filename, Assembler& ayM80);
+std::string format_cross_reference(Assembler& ayM80);
 std::string get_base_filename(const std::string& path); 
+std::string strip_extension(const std::string& path);
 
 // Forward declarations for helper functions
-void write_binary_file(const std::string& filename, const std::vector<uint8_t>& data);
-void write_symbol_table(const std::string& filename, const std::map<std::string, uint16_t>& table);
+// The path without the extension of its file name; the directory is kept.
+std::string strip_extension(const std::string& path) {
+    size_t last_slash = path.find_last_of("/\\");
+    size_t last_dot = path.rfind('.');
+    if (last_dot == std::string::npos || (last_slash != std::string::npos && last_dot < last_slash)) return path;
+    return path.substr(0, last_dot);
+}
+
+std::string format_symbol_table(const std::map<std::string, uint16_t>& table);
+std::string report_macro_profile(const std::map<std::string, MacroProfile>& profiles);
+std::string format_dependencies(const std::vector<std::string>& targets, const std::vector<std::string>& prerequisites);
+
+// Output files to produce from an assembly.
+struct OutputOptions {
+    bool save_symtab = false;
+    bool generate_listing = false;
+    bool generate_cref = false;
+    bool macro_profile = false;
+    OutputFormat format = OutputFormat::BINARY;
+    bool delta = false;         // Write an IPS patch from delta_base to the new binary.
+    std::vector<uint8_t> delta_base;
+    uint32_t delta_sector = 0;  // Patch whole sectors of this size; 0 patches just the changed bytes.
+    bool line_table = false;    // Write the .dbg address-to-line table.
+    std::string source_filename;
+};
+
+// A build variant from a --variants file: a name and the -D definitions that select it.
+struct Variant {
+    std::string name;
+    std::vector<std::string> defines;
+};
+
+// A message for the console, printed by flush_artifacts once the file it names has been written.
+struct WriteReport {
+    std::string filename;
+    std::string message;
+};
+
+bool read_variants_file(const std::string& filename, std::vector<Variant>& variants, std::string& error);
+bool write_outputs(Assembler& ayM80, const std::string& base_name, const std::string& out_filename, const OutputOptions& options,
+                   const std::string& listing, MappedOutput* mapped, ArtifactWriter& artifacts, std::vector<WriteReport>& reports);
+bool flush_artifacts(ArtifactWriter& artifacts, const std::vector<WriteReport>& reports);
 
 // *** Main application logic for M80-Compatible-Assembler ***
 int main(int argc, char* argv[]) {
     if (argc < 2) {
         // Updated usage message to show new switches (/l and /O)
-        std::cerr << "Usage: " << argv[0] << " <source.asm> [-o out.com] [-s] [/L] [/O]" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " <source.asm> [-o out.com] [-f bin|ihex|srec|sfx] [-s] [/L] [/O] [-M lib.mlb] [--make-library lib.mlb] [--macro-profile] [--mmap-output] [-MD] [-MF file.d]"
+                  << " [--delta-from old.com] [--delta-sector n] [-g]"
+                  << " [--max-macro-depth n] [--max-expanded-lines n] [--max-output-bytes n] [-j threads]"
+                  << " [-D name=value] [--variants file]" << std::endl;
         return 1;
     }
 
@@ -34,6 +87,28 @@ int main(int argc, char* argv[]) {
     bool octal_mode = false; 
     bool generate_cref = false;
 
+    // Precompiled macro libraries to preload, and the library to build from this source.
+    std::vector<std::string> library_filenames;
+    std::string make_library_filename = "";
+    bool macro_profile = false;
+    ExpansionLimits limits;
+    unsigned thread_count = 0;
+    OutputFormat output_format = OutputFormat::BINARY;
+    bool mmap_output = false;
+    bool line_table = false;
+
+    // Dependency file (-MD/-MF): a Makefile rule naming every file the run reads.
+    bool write_dependencies = false;
+    std::string dependency_filename = "";
+
+    // Previous image to write an IPS patch against, and the sector size to align it to.
+    std::string delta_filename = "";
+    unsigned long delta_sector = 0;
+
+    // Symbols defined on the command line, and the file listing variants to build in one run.
+    std::vector<std::string> defines;
+    std::string variants_filename = "";
+
     // *** NEW 9-15-25 ay: Updated argument parsing loop ***
     for (int i = 1; i < argc; ++i) {
         std::string arg = argv[i];
@@ -47,6 +122,91 @@ int main(int argc, char* argv[]) {
             } else {
                 std::cerr << "Error: -o switch requires a filename." << std::endl; return 1;
             }
+        } else if (arg == "-M") {
+            if (i + 1 < argc) {
+                library_filenames.push_back(argv[++i]);
+            } else {
+                std::cerr << "Error: -M switch requires a library filename." << std::endl; return 1;
+            }
+        } else if (arg == "--make-library") {
+            if (i + 1 < argc) {
+                make_library_filename = argv[++i];
+            } else {
+                std::cerr << "Error: --make-library switch requires a filename." << std::endl; return 1;
+            }
+        } else if (arg == "--max-macro-depth" || arg == "--max-expanded-lines" || arg == "--max-output-bytes") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: " << arg << " switch requires a number." << std::endl; return 1;
+            }
+            unsigned long long value = std::strtoull(argv[++i], nullptr, 10);
+            if (value == 0) {
+                std::cerr << "Error: " << arg << " must be a positive number." << std::endl; return 1;
+            }
+            if (arg == "--max-macro-depth") limits.max_depth = value;
+            else if (arg == "--max-expanded-lines") limits.max_lines = value;
+            else limits.max_bytes = value;
+        } else if (arg == "-j") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: -j switch requires a thread count." << std::endl; return 1;
+            }
+            // 0 is a valid count (one thread per core), so a bad number cannot be taken for it.
+            const char* count = argv[++i];
+            char* count_end = nullptr;
+            unsigned long value = std::strtoul(count, &count_end, 10);
+            if (!std::isdigit(static_cast<unsigned char>(count[0])) || *count_end != '\0' || value > 1024) {
+                std::cerr << "Error: -j needs a thread count from 0 to 1024, not " << count << "." << std::endl; return 1;
+            }
+            thread_count = value;
+        } else if (arg == "-f") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: -f switch requires a format." << std::endl; return 1;
+            }
+            if (!parse_output_format(argv[++i], output_format)) {
+                std::cerr << "Error: Unknown output format " << argv[i] << " (expected bin, ihex, srec or sfx)." << std::endl; return 1;
+            }
+        } else if (arg == "-D" || (arg.rfind("-D", 0) == 0 && arg.length() > 2)) {
+            if (arg.length() > 2) {
+                defines.push_back(arg.substr(2));
+            } else if (i + 1 < argc) {
+                defines.push_back(argv[++i]);
+            } else {
+                std::cerr << "Error: -D switch requires a symbol definition." << std::endl; return 1;
+            }
+        } else if (arg == "--variants") {
+            if (i + 1 < argc) {
+                variants_filename = argv[++i];
+            } else {
+                std::cerr << "Error: --variants switch requires a filename." << std::endl; return 1;
+            }
+        } else if (arg == "--macro-profile") {
+            macro_profile = true;
+        } else if (arg == "--mmap-output") {
+            mmap_output = true;
+        } else if (arg == "--delta-from") {
+            if (i + 1 < argc) {
+                delta_filename = argv[++i];
+            } else {
+                std::cerr << "Error: --delta-from switch requires a filename." << std::endl; return 1;
+            }
+        } else if (arg == "--delta-sector") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --delta-sector switch requires a number." << std::endl; return 1;
+            }
+            delta_sector = std::strtoul(argv[++i], nullptr, 0);
+            if (delta_sector == 0 || delta_sector > 0x10000) {
+                std::cerr << "Error: --delta-sector must be between 1 and 65536." << std::endl; return 1;
+            }
+        } else if (arg == "-MD") {
+            write_dependencies = true;
+        } else if (arg == "-MF") {
+            if (i + 1 < argc) {
+                dependency_filename = argv[++i];
+                write_dependencies = true;
+            } else {
+                std::cerr << "Error: -MF switch requires a filename." << std::endl; return 1;
+            }
+        } else if (arg == "-g") {
+            line_table = true;
         } else if (arg == "-s") {
             save_symtab = true;
         } else if (arg == "/L" || arg == "/l" || arg =="-L" || arg == "-l") {
@@ -71,6 +231,10 @@ int main(int argc, char* argv[]) {
         std::cerr << "Error: No input file specified." << std::endl;
     }
 
+    if (mmap_output && output_format != OutputFormat::BINARY) {
+        std::cerr << "Error: --mmap-output only applies to the binary output format." << std::endl; return 1;
+    }
+
     // Read input file
     std::ifstream infile(in_filename);
     if (!infile) {
@@ -84,50 +248,288 @@ int main(int argc, char* argv[]) {
     // Determine output filenames
     std::string base_name = get_base_filename(in_filename);
     if (out_filename.empty()) {
-        out_filename = base_name + ".com";
+        out_filename = base_name + output_extension(output_format);
     }
-    std::string sym_filename = base_name + ".sym";
     std::string lst_filename = base_name + ".lst"; // For listing filename
-    std::string crf_filename = base_name + ".crf"; 
-    
-    // *** Handle the listing file stream ***
-    std::ofstream listing_file;
-    if(generate_listing) {
-        listing_file.open(lst_filename);
-        if(!listing_file){
-            std::cerr << "ERROR: Cannot open listing file " << lst_filename << std::endl;
-            return 1;
+    OutputOptions output_options;
+    output_options.save_symtab = save_symtab;
+    output_options.generate_listing = generate_listing;
+    output_options.generate_cref = generate_cref;
+    output_options.macro_profile = macro_profile;
+    output_options.format = output_format;
+    output_options.line_table = line_table;
+    output_options.source_filename = in_filename;
+    if (!delta_filename.empty()) {
+        std::ifstream base_file(delta_filename, std::ios::binary);
+        if (!base_file) {
+            std::cerr << "Error: Cannot open delta base image " << delta_filename << std::endl; return 1;
+        }
+        output_options.delta = true;
+        output_options.delta_base.assign(std::istreambuf_iterator<char>(base_file), std::istreambuf_iterator<char>());
+        output_options.delta_sector = delta_sector;
+    } else if (delta_sector) {
+        std::cerr << "Error: --delta-sector requires --delta-from." << std::endl; return 1;
+    }
+
+    std::vector<Variant> variants;
+    if (!variants_filename.empty()) {
+        std::string error;
+        if (!read_variants_file(variants_filename, variants, error)) {
+            std::cerr << "Error: " << error << std::endl; return 1;
+        }
+        if (!make_library_filename.empty()) {
+            std::cerr << "Error: --make-library cannot be combined with --variants." << std::endl; return 1;
         }
     }
 
+    // *** Handle the listing file stream ***
+    // The listing is collected in memory and written with the other artifacts at the end.
+    std::ostringstream listing_text;
+    ArtifactWriter artifacts;
+
+    // Everything this run reads, for the dependency file. The .d file is named after the output, next to it.
+    std::vector<std::string> dependencies = { in_filename };
+    dependencies.insert(dependencies.end(), library_filenames.begin(), library_filenames.end());
+    if (!variants_filename.empty()) dependencies.push_back(variants_filename);
+    if (!delta_filename.empty()) dependencies.push_back(delta_filename);
+    if (dependency_filename.empty()) dependency_filename = strip_extension(out_filename) + ".d";
+
     // Assemble the code
     Assembler ayM80;
+    for (const auto& library_filename : library_filenames) {
+        MacroLibrary library;
+        std::string error;
+        if (!load_macro_library(library_filename, library, error)) {
+            std::cerr << "Error: " << error << std::endl;
+            return 1;
+        }
+        ayM80.add_macro_library(library);
+    }
     if(generate_listing){
-        ayM80.set_listing_stream(listing_file); // giving the stream to the assembler
+        ayM80.set_listing_stream(listing_text); // giving the stream to the assembler
     }
     ayM80.set_octal_mode(octal_mode);
+    ayM80.set_cross_reference(generate_cref);   // Without /C, no pass records references.
+    ayM80.set_macro_profiling(macro_profile);
+    ayM80.set_expansion_limits(limits);
+    ayM80.set_thread_count(thread_count);
+    // With --mmap-output, pass 2 encodes into a mapping of the output file.
+    std::unique_ptr<MappedOutput> mapped_output;
+    if (mmap_output) {
+        mapped_output = std::make_unique<MappedOutput>(out_filename);
+        ayM80.set_output_mapper([&](size_t size) { return mapped_output->map(size); });
+    }
+    ayM80.set_line_table(line_table);
+    for (const auto& define : defines) {
+        if (!ayM80.define_symbol(define)) {
+            std::cerr << "Error: Invalid symbol definition " << define << std::endl; return 1;
+        }
+    }
+
+    // Variant builds lex the source and compile its macros once, then assemble every variant
+    // from that shared prepared source on its own thread. Outputs are named <base>_<variant>.
+    if (!variants.empty()) {
+        std::shared_ptr<const PreparedSource> prepared = ayM80.prepare(lines);
+        std::string variant_base = strip_extension(out_filename);
+        std::vector<std::unique_ptr<Assembler>> builds;
+        std::vector<std::unique_ptr<std::ostringstream>> listings;
+        std::vector<std::unique_ptr<MappedOutput>> mapped_outputs;
+        std::vector<std::string> targets;
+        for (const auto& variant : variants) {
+            targets.push_back(variant_base + "_" + variant.name + output_extension(output_options.format));
+            builds.push_back(std::make_unique<Assembler>());
+            Assembler& build = *builds.back();
+            build.set_octal_mode(octal_mode);
+            build.set_cross_reference(generate_cref);
+            build.set_macro_profiling(macro_profile);
+            build.set_expansion_limits(limits);
+            build.set_thread_count(1);  // The variants themselves are spread over the threads.
+            build.set_line_table(line_table);
+            mapped_outputs.emplace_back();
+            if (mmap_output) {
+                mapped_outputs.back() = std::make_unique<MappedOutput>(targets.back());
+                MappedOutput* mapped = mapped_outputs.back().get();
+                build.set_output_mapper([mapped](size_t size) { return mapped->map(size); });
+            }
+            build.set_error_prefix("[" + variant.name + "] ");
+            build.set_throw_errors(true);   // Errors are collected per variant, not exited on from a worker thread.
+            for (const auto& define : defines) build.define_symbol(define);
+            for (const auto& define : variant.defines) {
+                if (!build.define_symbol(define)) {
+                    std::cerr << "Error: Invalid symbol definition " << define << " in variant " << variant.name << std::endl; return 1;
+                }
+            }
+            listings.emplace_back();
+            if (generate_listing) {
+                listings.back() = std::make_unique<std::ostringstream>();
+                build.set_listing_stream(*listings.back());
+            }
+        }
+        // A failed variant keeps its diagnostic; the others still build and are written.
+        std::vector<std::string> failures(builds.size());
+        parallel_for(builds.size(), resolve_thread_count(thread_count), [&](size_t begin, size_t end) {
+            for (size_t v = begin; v < end; ++v) {
+                try {
+                    builds[v]->assemble(prepared);
+                } catch (const std::exception& e) {
+                    failures[v] = e.what();
+                }
+            }
+        });
+        bool all_built = true;
+        std::vector<std::string> built_targets;
+        std::vector<WriteReport> reports;
+        for (size_t v = 0; v < variants.size(); ++v) {
+            if (!failures[v].empty()) { std::cerr << failures[v] << std::endl; all_built = false; continue; }
+            bool queued = write_outputs(*builds[v], variant_base + "_" + variants[v].name, targets[v], output_options,
+                                        listings[v] ? listings[v]->str() : std::string(), mapped_outputs[v].get(), artifacts, reports);
+            listings[v].reset();
+            if (!queued) { all_built = false; continue; }
+            built_targets.push_back(targets[v]);
+        }
+        if (write_dependencies) artifacts.add(dependency_filename, format_dependencies(built_targets, dependencies));
+        // One flush for the whole batch, so all variants' files are written together.
+        return flush_artifacts(artifacts, reports) && all_built ? 0 : 1;
+    }
+
     ayM80.assemble(lines);
-        
-    // Write output files
-    write_binary_file(out_filename, ayM80.getOutput());
-    std::cout << ayM80.getOutput().size() << " bytes written to " << out_filename << std::endl;
 
-    if (generate_cref) {
-        write_cross_reference_file(crf_filename, ayM80);
-        std::cout << "Cross-Reference file written to " << crf_filename << std::endl;
+    // Library builds write the compiled macros and equates instead of a program.
+    if (!make_library_filename.empty()) {
+        MacroLibrary library = ayM80.build_macro_library();
+        if (!write_macro_library(make_library_filename, library)) {
+            std::cerr << "Error: Cannot write macro library " << make_library_filename << std::endl;
+            return 1;
+        }
+        std::cout << library.macros.size() << " macros and " << library.equates.size() << " equates written to " << make_library_filename << std::endl;
+        if (generate_listing) artifacts.add(lst_filename, listing_text.str());
+        if (write_dependencies) artifacts.add(dependency_filename, format_dependencies({ make_library_filename }, dependencies));
+        return flush_artifacts(artifacts, {}) ? 0 : 1;
     }
-    if (generate_listing) {
-        std::cout << "Listing file written to " << lst_filename << std::endl;
+
+    std::vector<WriteReport> reports;
+    if (!write_outputs(ayM80, base_name, out_filename, output_options, listing_text.str(), mapped_output.get(), artifacts, reports)) return 1;
+    if (write_dependencies) artifacts.add(dependency_filename, format_dependencies({ out_filename }, dependencies));
+    return flush_artifacts(artifacts, reports) ? 0 : 1;
+}
+
+// Helper function implementations
+// Queues the machine code, the listing collected during pass 2 and whichever of the symbol,
+// cross-reference, profile, delta patch and line table files were requested; they are written by the next flush_artifacts,
+// which also prints the `reports` added here for them.
+// A program pass 2 encoded into `mapped` (--mmap-output) is put in place here instead, or queued
+// like the others if that fails. Returns false, after reporting why, if the program cannot be built.
+bool write_outputs(Assembler& ayM80, const std::string& base_name, const std::string& out_filename, const OutputOptions& options,
+                   const std::string& listing, MappedOutput* mapped, ArtifactWriter& artifacts, std::vector<WriteReport>& reports) {
+    std::string sym_filename = base_name + ".sym";
+    std::string lst_filename = base_name + ".lst";
+    std::string crf_filename = base_name + ".crf";
+    std::string profile_filename = base_name + ".mprof.json";
+    std::string ips_filename = base_name + ".ips";
+    std::string dbg_filename = base_name + ".dbg";
+
+    size_t written = ayM80.getOutputSize();
+    if (mapped && ayM80.is_output_mapped()) {
+        if (!mapped->commit(written)) {
+            std::string program(written, '\0');
+            ayM80.copy_output(reinterpret_cast<uint8_t*>(&program[0]));
+            artifacts.add(out_filename, std::move(program));
+        }
+    } else if (options.format == OutputFormat::SELF_EXTRACTING) {
+        SelfExtractingImage packed;
+        std::string error;
+        if (!pack_self_extracting(ayM80.getOutput(), ayM80.getOutputOrigin(), packed, error)) {
+            std::cerr << "Error: " << error << std::endl;
+            return false;
+        }
+        std::ostringstream report;
+        report << std::fixed << std::setprecision(1) << "Packed " << written << " bytes into " << packed.file.size()
+               << " (" << (written ? 100.0 * packed.file.size() / written : 100.0) << "%); unpacks from "
+               << std::hex << std::uppercase << std::setw(4) << std::setfill('0') << packed.high << "H" << std::dec
+               << " in about " << packed.states << " T-states (" << packed.states / 2000.0 << " ms at 2 MHz)";
+        std::cout << report.str() << std::endl;
+        written = packed.file.size();
+        artifacts.add(out_filename, std::string(packed.file.begin(), packed.file.end()));
+    } else {
+        artifacts.add(out_filename, format_program(ayM80, options.format));
+        if (options.format != OutputFormat::BINARY) {
+            written = 0;
+            for (const auto& range : ayM80.getOutputRanges()) written += range.size;
+        }
     }
-    if (save_symtab) {
-        write_symbol_table(sym_filename, ayM80.getSymbolTable());
-        std::cout << ayM80.getSymbolTable().size() << " symbols written to " << sym_filename << std::endl;
+    reports.push_back({ out_filename, std::to_string(written) + " bytes written to " + out_filename });
+
+    if (options.delta) {
+        std::vector<uint8_t> image(ayM80.getOutputSize());
+        ayM80.copy_output(image.data());
+        std::vector<PatchRange> ranges = diff_images(options.delta_base, image, ayM80.getOutputOrigin(), options.delta_sector);
+        size_t changed = 0;
+        for (const auto& range : ranges) changed += range.size;
+        std::string patch = format_ips(options.delta_base, image, ranges);
+        reports.push_back({ ips_filename, std::to_string(changed) + " bytes in " + std::to_string(ranges.size()) + " ranges patched by " + ips_filename +
+                                          " (" + std::to_string(patch.size()) + " bytes)" });
+        artifacts.add(ips_filename, std::move(patch));
     }
 
-    return 0;
+    if (options.generate_cref) {
+        if (!ayM80.getCrossReferenceData().empty()) {
+            artifacts.add(crf_filename, format_cross_reference(ayM80));
+            reports.push_back({ crf_filename, std::to_string(ayM80.getCrossReferenceData().size()) + " symbols written to " + crf_filename });
+        }
+        reports.push_back({ crf_filename, "Cross-Reference file written to " + crf_filename });
+    }
+    if (options.generate_listing) {
+        artifacts.add(lst_filename, listing);
+        reports.push_back({ lst_filename, "Listing file written to " + lst_filename });
+    }
+    if (options.save_symtab) {
+        if (!ayM80.getSymbolTable().empty()) artifacts.add(sym_filename, format_symbol_table(ayM80.getSymbolTable()));
+        reports.push_back({ sym_filename, std::to_string(ayM80.getSymbolTable().size()) + " symbols written to " + sym_filename });
+    }
+    if (options.line_table) {
+        artifacts.add(dbg_filename, format_line_table({ options.source_filename }, ayM80.getLineTable()));
+        reports.push_back({ dbg_filename, std::to_string(ayM80.getLineTable().size()) + " line table entries written to " + dbg_filename });
+    }
+    if (options.macro_profile) {
+        artifacts.add(profile_filename, report_macro_profile(ayM80.getMacroProfile()));
+        reports.push_back({ profile_filename, "Macro profile written to " + profile_filename });
+    }
+    return true;
 }
 
-// Helper function implementations
+// Writes every queued artifact at once, then prints the reports of the files that were written.
+// Returns false, after naming them, if any could not be written.
+bool flush_artifacts(ArtifactWriter& artifacts, const std::vector<WriteReport>& reports) {
+    std::vector<std::string> failed;
+    bool all_written = artifacts.flush(failed);
+    for (const auto& report : reports) {
+        if (std::find(failed.begin(), failed.end(), report.filename) == failed.end()) std::cout << report.message << std::endl;
+    }
+    for (const auto& filename : failed) std::cerr << "Error: Cannot write output file " << filename << std::endl;
+    return all_written;
+}
+
+// Reads a --variants file. Each line names a variant followed by its definitions,
+// e.g. "board_a CPU_MHZ=6 HAS_UART=1"; blank lines and ';' comments are ignored.
+bool read_variants_file(const std::string& filename, std::vector<Variant>& variants, std::string& error) {
+    std::ifstream infile(filename);
+    if (!infile) { error = "Cannot open variants file " + filename; return false; }
+    std::string line;
+    while (std::getline(infile, line)) {
+        line = line.substr(0, line.find(';'));
+        std::stringstream ss(line);
+        Variant variant;
+        if (!(ss >> variant.name)) continue;
+        for (const auto& other : variants) {
+            if (other.name == variant.name) { error = "Duplicate variant " + variant.name + " in " + filename; return false; }
+        }
+        std::string define;
+        while (ss >> define) variant.defines.push_back(define);
+        variants.push_back(variant);
+    }
+    if (variants.empty()) { error = "No variants in " + filename; return false; }
+    return true;
+}
 std::string get_base_filename(const std::string& path) {
     size_t last_slash = path.find_last_of("/\\");
     std::string filename = (last_slash == std::string::npos) ? path : path.substr(last_slash + 1);
@@ -135,22 +537,8 @@ std::string get_base_filename(const std::string& path) {
     return (last_dot == std::string::npos) ? filename : filename.substr(0, last_dot);
 }
 
-void write_binary_file(const std::string& filename, const std::vector<uint8_t>& data) {
-    std::ofstream outfile(filename, std::ios::binary);
-    if (!outfile) {
-        std::cerr << "Error: Cannot open output file " << filename << std::endl;
-        exit(1);
-    }
-    outfile.write(reinterpret_cast<const char*>(data.data()), data.size());
-}
-
-void write_symbol_table(const std::string& filename, const std::map<std::string, uint16_t>& table) {
-    if (table.empty()) return;
-    std::ofstream outfile(filename);
-    if (!outfile) {
-        std::cerr << "Error: Cannot open symbol file " << filename << std::endl;
-        exit(1);
-    }
+std::string format_symbol_table(const std::map<std::string, uint16_t>& table) {
+    std::ostringstream outfile;
     
     // Set up stream to print hex values
     outfile << std::hex << std::uppercase << std::setfill('0');
@@ -161,19 +549,14 @@ void write_symbol_table(const std::string& filename, const std::map<std::string,
         
         outfile << std::setw(4) << pair.second << " " << symbol << std::endl;
     }
+    return outfile.str();
 }
 
-void write_cross_reference_file(const std::string& filename, Assembler& ayM80) {
+std::string format_cross_reference(Assembler& ayM80) {
     const auto& crf_data = ayM80.getCrossReferenceData();
     const auto& sym_table = ayM80.getSymbolTable();
-    if (crf_data.empty()) return;
-
-    std::ofstream outfile(filename);
-    if (!outfile) {
-        std::cerr << "ERROR: Cannot open cross-reference file " << filename << std::endl;
-        return;
-    }
 
+    std::ostringstream outfile;
     outfile << "--- Cross-Reference Listing ---\n\n";
 
     for (const auto& pair : crf_data) {
@@ -198,5 +581,54 @@ void write_cross_reference_file(const std::string& filename, Assembler& ayM80) {
         }
         outfile << std::endl;
     }
-    std::cout << crf_data.size() << " symbols written to " << filename << std::endl;
-}
\ No newline at end of file
+    return outfile.str();
+}
+
+// Prints the macro profile as a table sorted by expansion time, and returns the same data as JSON.
+std::string report_macro_profile(const std::map<std::string, MacroProfile>& profiles) {
+    std::vector<std::pair<std::string, MacroProfile>> sorted(profiles.begin(), profiles.end());
+    std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) {
+        return a.second.seconds > b.second.seconds;
+    });
+
+    std::cout << std::left << std::setw(20) << "Macro" << std::right << std::setw(10) << "Calls"
+              << std::setw(12) << "Lines" << std::setw(10) << "Bytes" << std::setw(12) << "Time (ms)" << std::endl;
+    for (const auto& pair : sorted) {
+        const MacroProfile& profile = pair.second;
+        std::string name = pair.first;
+        std::transform(name.begin(), name.end(), name.begin(), ::toupper);
+        std::cout << std::left << std::setw(20) << name << std::right << std::setw(10) << profile.invocations
+                  << std::setw(12) << profile.lines << std::setw(10) << profile.bytes
+                  << std::setw(12) << std::fixed << std::setprecision(3) << profile.seconds * 1000.0 << std::endl;
+    }
+
+    std::ostringstream outfile;
+    outfile << "{\n  \"macros\": [";
+    for (size_t i = 0; i < sorted.size(); ++i) {
+        const MacroProfile& profile = sorted[i].second;
+        outfile << (i ? "," : "") << "\n    { \"name\": \"" << sorted[i].first << "\", \"invocations\": " << profile.invocations
+                << ", \"lines\": " << profile.lines << ", \"bytes\": " << profile.bytes
+                << ", \"seconds\": " << std::setprecision(6) << profile.seconds << " }";
+    }
+    outfile << "\n  ]\n}" << std::endl;
+    return outfile.str();
+}
+
+// Builds a Makefile rule making the targets depend on every file the run read. Spaces and '#'
+// are escaped with a backslash and '$' is doubled, as make expects.
+std::string format_dependencies(const std::vector<std::string>& targets, const std::vector<std::string>& prerequisites) {
+    auto escape = [](const std::string& path) {
+        std::string escaped;
+        for (char c : path) {
+            if (c == ' ' || c == '#') escaped += '\\';
+            else if (c == '$') escaped += '$';
+            escaped += c;
+        }
+        return escaped;
+    };
+    std::string rule;
+    for (const auto& target : targets) rule += (rule.empty() ? "" : " ") + escape(target);
+    rule += ":";
+    for (const auto& prerequisite : prerequisites) rule += " \\\n  " + escape(prerequisite);
+    return rule + "\n";
+}
@@ -0,0 +1,4 @@
+; bad_library.mlb is library.mlb with a parameter slot past the macro's parameters: -M must reject it
+        org 100h
+        outp 10h, 3
+        end
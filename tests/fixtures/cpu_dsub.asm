@@ -0,0 +1,10 @@
+; DSUB is an undocumented 8085 instruction: a macro using it must fail again after .8080
+m       macro
+        dsub
+        endm
+        .8085u
+        m
+        m
+        .8080
+        m
+        end
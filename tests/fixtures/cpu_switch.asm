@@ -0,0 +1,108 @@
+; one macro expanded under .Z80 and then under .8080: JP/CP change meaning with the CPU
+        org 100h
+x       equ 100h
+m       macro
+        jp x
+        cp 5
+        endm
+n       macro v
+        jp v
+        cp v
+        endm
+        .z80
+        m
+        m
+near:   jr near
+        djnz far
+        ld ix, 1234h
+        ld (iy+5), a
+        n 0
+        n 1
+        n 2
+        n 3
+        n 4
+        n 5
+        n 6
+        n 7
+        n 8
+        n 9
+        n 10
+        n 11
+        n 12
+        n 13
+        n 14
+        n 15
+        n 16
+        n 17
+        n 18
+        n 19
+        n 20
+        n 21
+        n 22
+        n 23
+        n 24
+        n 25
+        n 26
+        n 27
+        n 28
+        n 29
+        n 30
+        n 31
+        n 32
+        n 33
+        n 34
+        n 35
+        n 36
+        n 37
+        n 38
+        n 39
+        .8080
+        m
+        m
+        n 0
+        n 1
+        n 2
+        n 3
+        n 4
+        n 5
+        n 6
+        n 7
+        n 8
+        n 9
+        n 10
+        n 11
+        n 12
+        n 13
+        n 14
+        n 15
+        n 16
+        n 17
+        n 18
+        n 19
+        n 20
+        n 21
+        n 22
+        n 23
+        n 24
+        n 25
+        n 26
+        n 27
+        n 28
+        n 29
+        n 30
+        n 31
+        n 32
+        n 33
+        n 34
+        n 35
+        n 36
+        n 37
+        n 38
+        n 39
+        .z80
+        m
+        .8080
+        m
+        ds 200
+far:    nop
+        end
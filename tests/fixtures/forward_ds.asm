@@ -0,0 +1,7 @@
+; DS with a forward size: pass 2 writes past what pass 1 sized
+        org 100h
+start:  ds n
+        db 1, 2, 3
+        jmp start
+n       equ 10
+        end
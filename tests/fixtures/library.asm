@@ -0,0 +1,9 @@
+; uses the macros and equates of library.mac, once from the compiled library and once inline
+        org 100h
+start:  nop
+        outp port, 3
+        delay 5
+        delay 6
+        outp port+1, 0
+        jmp start
+        end
@@ -0,0 +1,10 @@
+; run with --max-expanded-lines 40: the REPT inside the macro needs 60 lines and is stopped
+        org 100h
+fill    macro v
+        rept 30
+        db v
+        endm
+        endm
+        fill 1
+        fill 2
+        end
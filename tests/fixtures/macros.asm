@@ -0,0 +1,37 @@
+        org 100h
+debug   equ 1
+outp    macro port, val
+        mvi a, val
+        out port
+        endm
+delay   macro cnt
+        local lp
+        mvi c, cnt
+lp:     dcr c
+        jnz lp
+        endm
+twice   macro x
+        outp x, x
+        outp x, 0
+        endm
+data    macro a
+        db a
+        endm
+start:  nop
+        outp 10h, 3
+        outp 10h, 3
+        delay 5
+        delay 6
+        twice 7
+        if debug
+        mvi a, 1
+        if debug - 1
+        mvi a, 2
+        endif
+        endif
+        if debug eq 0
+        hlt
+        endif
+        data 5
+        jmp start
+        end
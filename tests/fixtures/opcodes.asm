@@ -0,0 +1,106 @@
+; exercise every 8080/8085 mnemonic
+        org 0
+count   equ 10
+port    equ 20h
+start:  nop
+        lxi b, 1234h
+        lxi d, table
+        lxi h, start
+        lxi sp, 0FFFFh
+        stax b
+        stax d
+        inx b
+        inx sp
+        inr a
+        inr m
+        dcr c
+        mvi a, count
+        mvi m, 41h
+        rlc
+        dad h
+        ldax d
+        dcx h
+        rrc
+        ral
+        rar
+        shld table
+        daa
+        lhld table+2
+        cma
+        sta table
+        stc
+        lda table
+        cmc
+        mov a, b
+        mov m, a
+        mov e, m
+        hlt
+        add b
+        adc c
+        sub d
+        sbb e
+        ana h
+        xra l
+        ora m
+        cmp a
+        rnz
+        pop psw
+        pop b
+        jnz start
+        jmp fwd
+        cnz start
+        push psw
+        push h
+        adi 5
+        rst 7
+        rz
+        ret
+        jz start
+        cz start
+        call fwd
+        aci 1
+        rnc
+        jnc start
+        out port
+        cnc start
+        sui 2
+        rc
+        jc start
+        in port
+        cc start
+        sbi 3
+        rpo
+        jpo start
+        xthl
+        cpo start
+        ani 0Fh
+        rpe
+        pchl
+        jpe start
+        xchg
+        cpe start
+        xri 0AAh
+        rp
+        jp start
+        di
+        cp start
+        ori 80h
+        rm
+        sphl
+        jm start
+        ei
+        cm start
+        cpi 5Ah
+        sim
+        rim
+fwd:    mvi a, 12h
+        mvi b, 34h
+        lxi h, (table + 4) * 2 - 1
+        mvi c, 1010b
+        mvi d, 17q
+        mvi e, 7 and 3 or 8 xor 1
+table:  db 1, 2, 'hi', "there", <3, 4>, 'x'
+        dw table, 1234h, $
+        ds 4
+        ds 2, 0FFh
+        end
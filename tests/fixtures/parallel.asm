@@ -0,0 +1,2176 @@
+; a long program for the parallel passes: -j 1 and -j 4 must produce the same output
+        org 100h
+port    equ 10h
+outp    macro p, v
+        mvi a, v
+        out p
+        endm
+wait    macro n
+        local lp
+        mvi c, n
+lp:     dcr c
+        jnz lp
+        endm
+fast    equ 1
+s0:    lxi h, s7
+        outp port, 0
+        wait 1
+        dw s0, $
+        if fast
+        db 0
+        else
+        ds 2
+        endif
+s1:    lxi h, s8
+        outp port, 1
+        wait 2
+        dw s1, $
+        if fast
+        db 1
+        else
+        ds 2
+        endif
+s2:    lxi h, s9
+        outp port, 2
+        wait 3
+        dw s2, $
+        if fast
+        db 2
+        else
+        ds 2
+        endif
+s3:    lxi h, s10
+        outp port, 3
+        wait 4
+        dw s3, $
+        if fast
+        db 3
+        else
+        ds 2
+        endif
+s4:    lxi h, s11
+        outp port, 4
+        wait 5
+        dw s4, $
+        if fast
+        db 4
+        else
+        ds 2
+        endif
+s5:    lxi h, s12
+        outp port, 5
+        wait 6
+        dw s5, $
+        if fast
+        db 5
+        else
+        ds 2
+        endif
+s6:    lxi h, s13
+        outp port, 6
+        wait 7
+        dw s6, $
+        if fast
+        db 6
+        else
+        ds 2
+        endif
+s7:    lxi h, s14
+        outp port, 7
+        wait 8
+        dw s7, $
+        if fast
+        db 7
+        else
+        ds 2
+        endif
+s8:    lxi h, s15
+        outp port, 8
+        wait 9
+        dw s8, $
+        if fast
+        db 8
+        else
+        ds 2
+        endif
+s9:    lxi h, s16
+        outp port, 9
+        wait 10
+        dw s9, $
+        if fast
+        db 9
+        else
+        ds 2
+        endif
+s10:    lxi h, s17
+        outp port, 10
+        wait 11
+        dw s10, $
+        if fast
+        db 10
+        else
+        ds 2
+        endif
+s11:    lxi h, s18
+        outp port, 11
+        wait 12
+        dw s11, $
+        if fast
+        db 11
+        else
+        ds 2
+        endif
+s12:    lxi h, s19
+        outp port, 12
+        wait 13
+        dw s12, $
+        if fast
+        db 12
+        else
+        ds 2
+        endif
+s13:    lxi h, s20
+        outp port, 13
+        wait 14
+        dw s13, $
+        if fast
+        db 13
+        else
+        ds 2
+        endif
+s14:    lxi h, s21
+        outp port, 14
+        wait 15
+        dw s14, $
+        if fast
+        db 14
+        else
+        ds 2
+        endif
+s15:    lxi h, s22
+        outp port, 15
+        wait 16
+        dw s15, $
+        if fast
+        db 15
+        else
+        ds 2
+        endif
+s16:    lxi h, s23
+        outp port, 16
+        wait 17
+        dw s16, $
+        if fast
+        db 16
+        else
+        ds 2
+        endif
+s17:    lxi h, s24
+        outp port, 17
+        wait 1
+        dw s17, $
+        if fast
+        db 17
+        else
+        ds 2
+        endif
+s18:    lxi h, s25
+        outp port, 18
+        wait 2
+        dw s18, $
+        if fast
+        db 18
+        else
+        ds 2
+        endif
+s19:    lxi h, s26
+        outp port, 19
+        wait 3
+        dw s19, $
+        if fast
+        db 19
+        else
+        ds 2
+        endif
+s20:    lxi h, s27
+        outp port, 20
+        wait 4
+        dw s20, $
+        if fast
+        db 20
+        else
+        ds 2
+        endif
+s21:    lxi h, s28
+        outp port, 21
+        wait 5
+        dw s21, $
+        if fast
+        db 21
+        else
+        ds 2
+        endif
+s22:    lxi h, s29
+        outp port, 22
+        wait 6
+        dw s22, $
+        if fast
+        db 22
+        else
+        ds 2
+        endif
+s23:    lxi h, s30
+        outp port, 23
+        wait 7
+        dw s23, $
+        if fast
+        db 23
+        else
+        ds 2
+        endif
+s24:    lxi h, s31
+        outp port, 24
+        wait 8
+        dw s24, $
+        if fast
+        db 24
+        else
+        ds 2
+        endif
+s25:    lxi h, s32
+        outp port, 25
+        wait 9
+        dw s25, $
+        if fast
+        db 25
+        else
+        ds 2
+        endif
+s26:    lxi h, s33
+        outp port, 26
+        wait 10
+        dw s26, $
+        if fast
+        db 26
+        else
+        ds 2
+        endif
+s27:    lxi h, s34
+        outp port, 27
+        wait 11
+        dw s27, $
+        if fast
+        db 27
+        else
+        ds 2
+        endif
+s28:    lxi h, s35
+        outp port, 28
+        wait 12
+        dw s28, $
+        if fast
+        db 28
+        else
+        ds 2
+        endif
+s29:    lxi h, s36
+        outp port, 29
+        wait 13
+        dw s29, $
+        if fast
+        db 29
+        else
+        ds 2
+        endif
+s30:    lxi h, s37
+        outp port, 30
+        wait 14
+        dw s30, $
+        if fast
+        db 30
+        else
+        ds 2
+        endif
+s31:    lxi h, s38
+        outp port, 31
+        wait 15
+        dw s31, $
+        if fast
+        db 31
+        else
+        ds 2
+        endif
+s32:    lxi h, s39
+        outp port, 32
+        wait 16
+        dw s32, $
+        if fast
+        db 32
+        else
+        ds 2
+        endif
+s33:    lxi h, s40
+        outp port, 33
+        wait 17
+        dw s33, $
+        if fast
+        db 33
+        else
+        ds 2
+        endif
+s34:    lxi h, s41
+        outp port, 34
+        wait 1
+        dw s34, $
+        if fast
+        db 34
+        else
+        ds 2
+        endif
+s35:    lxi h, s42
+        outp port, 35
+        wait 2
+        dw s35, $
+        if fast
+        db 35
+        else
+        ds 2
+        endif
+s36:    lxi h, s43
+        outp port, 36
+        wait 3
+        dw s36, $
+        if fast
+        db 36
+        else
+        ds 2
+        endif
+s37:    lxi h, s44
+        outp port, 37
+        wait 4
+        dw s37, $
+        if fast
+        db 37
+        else
+        ds 2
+        endif
+s38:    lxi h, s45
+        outp port, 38
+        wait 5
+        dw s38, $
+        if fast
+        db 38
+        else
+        ds 2
+        endif
+s39:    lxi h, s46
+        outp port, 39
+        wait 6
+        dw s39, $
+        if fast
+        db 39
+        else
+        ds 2
+        endif
+s40:    lxi h, s47
+        outp port, 40
+        wait 7
+        dw s40, $
+        if fast
+        db 40
+        else
+        ds 2
+        endif
+s41:    lxi h, s48
+        outp port, 41
+        wait 8
+        dw s41, $
+        if fast
+        db 41
+        else
+        ds 2
+        endif
+s42:    lxi h, s49
+        outp port, 42
+        wait 9
+        dw s42, $
+        if fast
+        db 42
+        else
+        ds 2
+        endif
+s43:    lxi h, s50
+        outp port, 43
+        wait 10
+        dw s43, $
+        if fast
+        db 43
+        else
+        ds 2
+        endif
+s44:    lxi h, s51
+        outp port, 44
+        wait 11
+        dw s44, $
+        if fast
+        db 44
+        else
+        ds 2
+        endif
+s45:    lxi h, s52
+        outp port, 45
+        wait 12
+        dw s45, $
+        if fast
+        db 45
+        else
+        ds 2
+        endif
+s46:    lxi h, s53
+        outp port, 46
+        wait 13
+        dw s46, $
+        if fast
+        db 46
+        else
+        ds 2
+        endif
+s47:    lxi h, s54
+        outp port, 47
+        wait 14
+        dw s47, $
+        if fast
+        db 47
+        else
+        ds 2
+        endif
+s48:    lxi h, s55
+        outp port, 48
+        wait 15
+        dw s48, $
+        if fast
+        db 48
+        else
+        ds 2
+        endif
+s49:    lxi h, s56
+        outp port, 49
+        wait 16
+        dw s49, $
+        if fast
+        db 49
+        else
+        ds 2
+        endif
+s50:    lxi h, s57
+        outp port, 50
+        wait 17
+        dw s50, $
+        if fast
+        db 50
+        else
+        ds 2
+        endif
+s51:    lxi h, s58
+        outp port, 51
+        wait 1
+        dw s51, $
+        if fast
+        db 51
+        else
+        ds 2
+        endif
+s52:    lxi h, s59
+        outp port, 52
+        wait 2
+        dw s52, $
+        if fast
+        db 52
+        else
+        ds 2
+        endif
+s53:    lxi h, s60
+        outp port, 53
+        wait 3
+        dw s53, $
+        if fast
+        db 53
+        else
+        ds 2
+        endif
+s54:    lxi h, s61
+        outp port, 54
+        wait 4
+        dw s54, $
+        if fast
+        db 54
+        else
+        ds 2
+        endif
+s55:    lxi h, s62
+        outp port, 55
+        wait 5
+        dw s55, $
+        if fast
+        db 55
+        else
+        ds 2
+        endif
+s56:    lxi h, s63
+        outp port, 56
+        wait 6
+        dw s56, $
+        if fast
+        db 56
+        else
+        ds 2
+        endif
+s57:    lxi h, s64
+        outp port, 57
+        wait 7
+        dw s57, $
+        if fast
+        db 57
+        else
+        ds 2
+        endif
+s58:    lxi h, s65
+        outp port, 58
+        wait 8
+        dw s58, $
+        if fast
+        db 58
+        else
+        ds 2
+        endif
+s59:    lxi h, s66
+        outp port, 59
+        wait 9
+        dw s59, $
+        if fast
+        db 59
+        else
+        ds 2
+        endif
+s60:    lxi h, s67
+        outp port, 60
+        wait 10
+        dw s60, $
+        if fast
+        db 60
+        else
+        ds 2
+        endif
+s61:    lxi h, s68
+        outp port, 61
+        wait 11
+        dw s61, $
+        if fast
+        db 61
+        else
+        ds 2
+        endif
+s62:    lxi h, s69
+        outp port, 62
+        wait 12
+        dw s62, $
+        if fast
+        db 62
+        else
+        ds 2
+        endif
+s63:    lxi h, s70
+        outp port, 63
+        wait 13
+        dw s63, $
+        if fast
+        db 63
+        else
+        ds 2
+        endif
+s64:    lxi h, s71
+        outp port, 64
+        wait 14
+        dw s64, $
+        if fast
+        db 64
+        else
+        ds 2
+        endif
+s65:    lxi h, s72
+        outp port, 65
+        wait 15
+        dw s65, $
+        if fast
+        db 65
+        else
+        ds 2
+        endif
+s66:    lxi h, s73
+        outp port, 66
+        wait 16
+        dw s66, $
+        if fast
+        db 66
+        else
+        ds 2
+        endif
+s67:    lxi h, s74
+        outp port, 67
+        wait 17
+        dw s67, $
+        if fast
+        db 67
+        else
+        ds 2
+        endif
+s68:    lxi h, s75
+        outp port, 68
+        wait 1
+        dw s68, $
+        if fast
+        db 68
+        else
+        ds 2
+        endif
+s69:    lxi h, s76
+        outp port, 69
+        wait 2
+        dw s69, $
+        if fast
+        db 69
+        else
+        ds 2
+        endif
+s70:    lxi h, s77
+        outp port, 70
+        wait 3
+        dw s70, $
+        if fast
+        db 70
+        else
+        ds 2
+        endif
+s71:    lxi h, s78
+        outp port, 71
+        wait 4
+        dw s71, $
+        if fast
+        db 71
+        else
+        ds 2
+        endif
+s72:    lxi h, s79
+        outp port, 72
+        wait 5
+        dw s72, $
+        if fast
+        db 72
+        else
+        ds 2
+        endif
+s73:    lxi h, s80
+        outp port, 73
+        wait 6
+        dw s73, $
+        if fast
+        db 73
+        else
+        ds 2
+        endif
+s74:    lxi h, s81
+        outp port, 74
+        wait 7
+        dw s74, $
+        if fast
+        db 74
+        else
+        ds 2
+        endif
+s75:    lxi h, s82
+        outp port, 75
+        wait 8
+        dw s75, $
+        if fast
+        db 75
+        else
+        ds 2
+        endif
+s76:    lxi h, s83
+        outp port, 76
+        wait 9
+        dw s76, $
+        if fast
+        db 76
+        else
+        ds 2
+        endif
+s77:    lxi h, s84
+        outp port, 77
+        wait 10
+        dw s77, $
+        if fast
+        db 77
+        else
+        ds 2
+        endif
+s78:    lxi h, s85
+        outp port, 78
+        wait 11
+        dw s78, $
+        if fast
+        db 78
+        else
+        ds 2
+        endif
+s79:    lxi h, s86
+        outp port, 79
+        wait 12
+        dw s79, $
+        if fast
+        db 79
+        else
+        ds 2
+        endif
+s80:    lxi h, s87
+        outp port, 80
+        wait 13
+        dw s80, $
+        if fast
+        db 80
+        else
+        ds 2
+        endif
+s81:    lxi h, s88
+        outp port, 81
+        wait 14
+        dw s81, $
+        if fast
+        db 81
+        else
+        ds 2
+        endif
+s82:    lxi h, s89
+        outp port, 82
+        wait 15
+        dw s82, $
+        if fast
+        db 82
+        else
+        ds 2
+        endif
+s83:    lxi h, s90
+        outp port, 83
+        wait 16
+        dw s83, $
+        if fast
+        db 83
+        else
+        ds 2
+        endif
+s84:    lxi h, s91
+        outp port, 84
+        wait 17
+        dw s84, $
+        if fast
+        db 84
+        else
+        ds 2
+        endif
+s85:    lxi h, s92
+        outp port, 85
+        wait 1
+        dw s85, $
+        if fast
+        db 85
+        else
+        ds 2
+        endif
+s86:    lxi h, s93
+        outp port, 86
+        wait 2
+        dw s86, $
+        if fast
+        db 86
+        else
+        ds 2
+        endif
+s87:    lxi h, s94
+        outp port, 87
+        wait 3
+        dw s87, $
+        if fast
+        db 87
+        else
+        ds 2
+        endif
+s88:    lxi h, s95
+        outp port, 88
+        wait 4
+        dw s88, $
+        if fast
+        db 88
+        else
+        ds 2
+        endif
+s89:    lxi h, s96
+        outp port, 89
+        wait 5
+        dw s89, $
+        if fast
+        db 89
+        else
+        ds 2
+        endif
+s90:    lxi h, s97
+        outp port, 90
+        wait 6
+        dw s90, $
+        if fast
+        db 90
+        else
+        ds 2
+        endif
+s91:    lxi h, s98
+        outp port, 91
+        wait 7
+        dw s91, $
+        if fast
+        db 91
+        else
+        ds 2
+        endif
+s92:    lxi h, s99
+        outp port, 92
+        wait 8
+        dw s92, $
+        if fast
+        db 92
+        else
+        ds 2
+        endif
+s93:    lxi h, s100
+        outp port, 93
+        wait 9
+        dw s93, $
+        if fast
+        db 93
+        else
+        ds 2
+        endif
+s94:    lxi h, s101
+        outp port, 94
+        wait 10
+        dw s94, $
+        if fast
+        db 94
+        else
+        ds 2
+        endif
+s95:    lxi h, s102
+        outp port, 95
+        wait 11
+        dw s95, $
+        if fast
+        db 95
+        else
+        ds 2
+        endif
+s96:    lxi h, s103
+        outp port, 96
+        wait 12
+        dw s96, $
+        if fast
+        db 96
+        else
+        ds 2
+        endif
+s97:    lxi h, s104
+        outp port, 97
+        wait 13
+        dw s97, $
+        if fast
+        db 97
+        else
+        ds 2
+        endif
+s98:    lxi h, s105
+        outp port, 98
+        wait 14
+        dw s98, $
+        if fast
+        db 98
+        else
+        ds 2
+        endif
+s99:    lxi h, s106
+        outp port, 99
+        wait 15
+        dw s99, $
+        if fast
+        db 99
+        else
+        ds 2
+        endif
+s100:    lxi h, s107
+        outp port, 100
+        wait 16
+        dw s100, $
+        if fast
+        db 100
+        else
+        ds 2
+        endif
+s101:    lxi h, s108
+        outp port, 101
+        wait 17
+        dw s101, $
+        if fast
+        db 101
+        else
+        ds 2
+        endif
+s102:    lxi h, s109
+        outp port, 102
+        wait 1
+        dw s102, $
+        if fast
+        db 102
+        else
+        ds 2
+        endif
+s103:    lxi h, s110
+        outp port, 103
+        wait 2
+        dw s103, $
+        if fast
+        db 103
+        else
+        ds 2
+        endif
+s104:    lxi h, s111
+        outp port, 104
+        wait 3
+        dw s104, $
+        if fast
+        db 104
+        else
+        ds 2
+        endif
+s105:    lxi h, s112
+        outp port, 105
+        wait 4
+        dw s105, $
+        if fast
+        db 105
+        else
+        ds 2
+        endif
+s106:    lxi h, s113
+        outp port, 106
+        wait 5
+        dw s106, $
+        if fast
+        db 106
+        else
+        ds 2
+        endif
+s107:    lxi h, s114
+        outp port, 107
+        wait 6
+        dw s107, $
+        if fast
+        db 107
+        else
+        ds 2
+        endif
+s108:    lxi h, s115
+        outp port, 108
+        wait 7
+        dw s108, $
+        if fast
+        db 108
+        else
+        ds 2
+        endif
+s109:    lxi h, s116
+        outp port, 109
+        wait 8
+        dw s109, $
+        if fast
+        db 109
+        else
+        ds 2
+        endif
+s110:    lxi h, s117
+        outp port, 110
+        wait 9
+        dw s110, $
+        if fast
+        db 110
+        else
+        ds 2
+        endif
+s111:    lxi h, s118
+        outp port, 111
+        wait 10
+        dw s111, $
+        if fast
+        db 111
+        else
+        ds 2
+        endif
+s112:    lxi h, s119
+        outp port, 112
+        wait 11
+        dw s112, $
+        if fast
+        db 112
+        else
+        ds 2
+        endif
+s113:    lxi h, s120
+        outp port, 113
+        wait 12
+        dw s113, $
+        if fast
+        db 113
+        else
+        ds 2
+        endif
+s114:    lxi h, s121
+        outp port, 114
+        wait 13
+        dw s114, $
+        if fast
+        db 114
+        else
+        ds 2
+        endif
+s115:    lxi h, s122
+        outp port, 115
+        wait 14
+        dw s115, $
+        if fast
+        db 115
+        else
+        ds 2
+        endif
+s116:    lxi h, s123
+        outp port, 116
+        wait 15
+        dw s116, $
+        if fast
+        db 116
+        else
+        ds 2
+        endif
+s117:    lxi h, s124
+        outp port, 117
+        wait 16
+        dw s117, $
+        if fast
+        db 117
+        else
+        ds 2
+        endif
+s118:    lxi h, s125
+        outp port, 118
+        wait 17
+        dw s118, $
+        if fast
+        db 118
+        else
+        ds 2
+        endif
+s119:    lxi h, s126
+        outp port, 119
+        wait 1
+        dw s119, $
+        if fast
+        db 119
+        else
+        ds 2
+        endif
+s120:    lxi h, s127
+        outp port, 120
+        wait 2
+        dw s120, $
+        if fast
+        db 120
+        else
+        ds 2
+        endif
+s121:    lxi h, s128
+        outp port, 121
+        wait 3
+        dw s121, $
+        if fast
+        db 121
+        else
+        ds 2
+        endif
+s122:    lxi h, s129
+        outp port, 122
+        wait 4
+        dw s122, $
+        if fast
+        db 122
+        else
+        ds 2
+        endif
+s123:    lxi h, s130
+        outp port, 123
+        wait 5
+        dw s123, $
+        if fast
+        db 123
+        else
+        ds 2
+        endif
+s124:    lxi h, s131
+        outp port, 124
+        wait 6
+        dw s124, $
+        if fast
+        db 124
+        else
+        ds 2
+        endif
+s125:    lxi h, s132
+        outp port, 125
+        wait 7
+        dw s125, $
+        if fast
+        db 125
+        else
+        ds 2
+        endif
+s126:    lxi h, s133
+        outp port, 126
+        wait 8
+        dw s126, $
+        if fast
+        db 126
+        else
+        ds 2
+        endif
+s127:    lxi h, s134
+        outp port, 127
+        wait 9
+        dw s127, $
+        if fast
+        db 127
+        else
+        ds 2
+        endif
+s128:    lxi h, s135
+        outp port, 128
+        wait 10
+        dw s128, $
+        if fast
+        db 128
+        else
+        ds 2
+        endif
+s129:    lxi h, s136
+        outp port, 129
+        wait 11
+        dw s129, $
+        if fast
+        db 129
+        else
+        ds 2
+        endif
+s130:    lxi h, s137
+        outp port, 130
+        wait 12
+        dw s130, $
+        if fast
+        db 130
+        else
+        ds 2
+        endif
+s131:    lxi h, s138
+        outp port, 131
+        wait 13
+        dw s131, $
+        if fast
+        db 131
+        else
+        ds 2
+        endif
+s132:    lxi h, s139
+        outp port, 132
+        wait 14
+        dw s132, $
+        if fast
+        db 132
+        else
+        ds 2
+        endif
+s133:    lxi h, s140
+        outp port, 133
+        wait 15
+        dw s133, $
+        if fast
+        db 133
+        else
+        ds 2
+        endif
+s134:    lxi h, s141
+        outp port, 134
+        wait 16
+        dw s134, $
+        if fast
+        db 134
+        else
+        ds 2
+        endif
+s135:    lxi h, s142
+        outp port, 135
+        wait 17
+        dw s135, $
+        if fast
+        db 135
+        else
+        ds 2
+        endif
+s136:    lxi h, s143
+        outp port, 136
+        wait 1
+        dw s136, $
+        if fast
+        db 136
+        else
+        ds 2
+        endif
+s137:    lxi h, s144
+        outp port, 137
+        wait 2
+        dw s137, $
+        if fast
+        db 137
+        else
+        ds 2
+        endif
+s138:    lxi h, s145
+        outp port, 138
+        wait 3
+        dw s138, $
+        if fast
+        db 138
+        else
+        ds 2
+        endif
+s139:    lxi h, s146
+        outp port, 139
+        wait 4
+        dw s139, $
+        if fast
+        db 139
+        else
+        ds 2
+        endif
+s140:    lxi h, s147
+        outp port, 140
+        wait 5
+        dw s140, $
+        if fast
+        db 140
+        else
+        ds 2
+        endif
+s141:    lxi h, s148
+        outp port, 141
+        wait 6
+        dw s141, $
+        if fast
+        db 141
+        else
+        ds 2
+        endif
+s142:    lxi h, s149
+        outp port, 142
+        wait 7
+        dw s142, $
+        if fast
+        db 142
+        else
+        ds 2
+        endif
+s143:    lxi h, s150
+        outp port, 143
+        wait 8
+        dw s143, $
+        if fast
+        db 143
+        else
+        ds 2
+        endif
+s144:    lxi h, s151
+        outp port, 144
+        wait 9
+        dw s144, $
+        if fast
+        db 144
+        else
+        ds 2
+        endif
+s145:    lxi h, s152
+        outp port, 145
+        wait 10
+        dw s145, $
+        if fast
+        db 145
+        else
+        ds 2
+        endif
+s146:    lxi h, s153
+        outp port, 146
+        wait 11
+        dw s146, $
+        if fast
+        db 146
+        else
+        ds 2
+        endif
+s147:    lxi h, s154
+        outp port, 147
+        wait 12
+        dw s147, $
+        if fast
+        db 147
+        else
+        ds 2
+        endif
+s148:    lxi h, s155
+        outp port, 148
+        wait 13
+        dw s148, $
+        if fast
+        db 148
+        else
+        ds 2
+        endif
+s149:    lxi h, s156
+        outp port, 149
+        wait 14
+        dw s149, $
+        if fast
+        db 149
+        else
+        ds 2
+        endif
+s150:    lxi h, s157
+        outp port, 150
+        wait 15
+        dw s150, $
+        if fast
+        db 150
+        else
+        ds 2
+        endif
+s151:    lxi h, s158
+        outp port, 151
+        wait 16
+        dw s151, $
+        if fast
+        db 151
+        else
+        ds 2
+        endif
+s152:    lxi h, s159
+        outp port, 152
+        wait 17
+        dw s152, $
+        if fast
+        db 152
+        else
+        ds 2
+        endif
+s153:    lxi h, s160
+        outp port, 153
+        wait 1
+        dw s153, $
+        if fast
+        db 153
+        else
+        ds 2
+        endif
+s154:    lxi h, s161
+        outp port, 154
+        wait 2
+        dw s154, $
+        if fast
+        db 154
+        else
+        ds 2
+        endif
+s155:    lxi h, s162
+        outp port, 155
+        wait 3
+        dw s155, $
+        if fast
+        db 155
+        else
+        ds 2
+        endif
+s156:    lxi h, s163
+        outp port, 156
+        wait 4
+        dw s156, $
+        if fast
+        db 156
+        else
+        ds 2
+        endif
+s157:    lxi h, s164
+        outp port, 157
+        wait 5
+        dw s157, $
+        if fast
+        db 157
+        else
+        ds 2
+        endif
+s158:    lxi h, s165
+        outp port, 158
+        wait 6
+        dw s158, $
+        if fast
+        db 158
+        else
+        ds 2
+        endif
+s159:    lxi h, s166
+        outp port, 159
+        wait 7
+        dw s159, $
+        if fast
+        db 159
+        else
+        ds 2
+        endif
+s160:    lxi h, s167
+        outp port, 160
+        wait 8
+        dw s160, $
+        if fast
+        db 160
+        else
+        ds 2
+        endif
+s161:    lxi h, s168
+        outp port, 161
+        wait 9
+        dw s161, $
+        if fast
+        db 161
+        else
+        ds 2
+        endif
+s162:    lxi h, s169
+        outp port, 162
+        wait 10
+        dw s162, $
+        if fast
+        db 162
+        else
+        ds 2
+        endif
+s163:    lxi h, s170
+        outp port, 163
+        wait 11
+        dw s163, $
+        if fast
+        db 163
+        else
+        ds 2
+        endif
+s164:    lxi h, s171
+        outp port, 164
+        wait 12
+        dw s164, $
+        if fast
+        db 164
+        else
+        ds 2
+        endif
+s165:    lxi h, s172
+        outp port, 165
+        wait 13
+        dw s165, $
+        if fast
+        db 165
+        else
+        ds 2
+        endif
+s166:    lxi h, s173
+        outp port, 166
+        wait 14
+        dw s166, $
+        if fast
+        db 166
+        else
+        ds 2
+        endif
+s167:    lxi h, s174
+        outp port, 167
+        wait 15
+        dw s167, $
+        if fast
+        db 167
+        else
+        ds 2
+        endif
+s168:    lxi h, s175
+        outp port, 168
+        wait 16
+        dw s168, $
+        if fast
+        db 168
+        else
+        ds 2
+        endif
+s169:    lxi h, s176
+        outp port, 169
+        wait 17
+        dw s169, $
+        if fast
+        db 169
+        else
+        ds 2
+        endif
+s170:    lxi h, s177
+        outp port, 170
+        wait 1
+        dw s170, $
+        if fast
+        db 170
+        else
+        ds 2
+        endif
+s171:    lxi h, s178
+        outp port, 171
+        wait 2
+        dw s171, $
+        if fast
+        db 171
+        else
+        ds 2
+        endif
+s172:    lxi h, s179
+        outp port, 172
+        wait 3
+        dw s172, $
+        if fast
+        db 172
+        else
+        ds 2
+        endif
+s173:    lxi h, s180
+        outp port, 173
+        wait 4
+        dw s173, $
+        if fast
+        db 173
+        else
+        ds 2
+        endif
+s174:    lxi h, s181
+        outp port, 174
+        wait 5
+        dw s174, $
+        if fast
+        db 174
+        else
+        ds 2
+        endif
+s175:    lxi h, s182
+        outp port, 175
+        wait 6
+        dw s175, $
+        if fast
+        db 175
+        else
+        ds 2
+        endif
+s176:    lxi h, s183
+        outp port, 176
+        wait 7
+        dw s176, $
+        if fast
+        db 176
+        else
+        ds 2
+        endif
+s177:    lxi h, s184
+        outp port, 177
+        wait 8
+        dw s177, $
+        if fast
+        db 177
+        else
+        ds 2
+        endif
+s178:    lxi h, s185
+        outp port, 178
+        wait 9
+        dw s178, $
+        if fast
+        db 178
+        else
+        ds 2
+        endif
+s179:    lxi h, s186
+        outp port, 179
+        wait 10
+        dw s179, $
+        if fast
+        db 179
+        else
+        ds 2
+        endif
+s180:    lxi h, s187
+        outp port, 180
+        wait 11
+        dw s180, $
+        if fast
+        db 180
+        else
+        ds 2
+        endif
+s181:    lxi h, s188
+        outp port, 181
+        wait 12
+        dw s181, $
+        if fast
+        db 181
+        else
+        ds 2
+        endif
+s182:    lxi h, s189
+        outp port, 182
+        wait 13
+        dw s182, $
+        if fast
+        db 182
+        else
+        ds 2
+        endif
+s183:    lxi h, s190
+        outp port, 183
+        wait 14
+        dw s183, $
+        if fast
+        db 183
+        else
+        ds 2
+        endif
+s184:    lxi h, s191
+        outp port, 184
+        wait 15
+        dw s184, $
+        if fast
+        db 184
+        else
+        ds 2
+        endif
+s185:    lxi h, s192
+        outp port, 185
+        wait 16
+        dw s185, $
+        if fast
+        db 185
+        else
+        ds 2
+        endif
+s186:    lxi h, s193
+        outp port, 186
+        wait 17
+        dw s186, $
+        if fast
+        db 186
+        else
+        ds 2
+        endif
+s187:    lxi h, s194
+        outp port, 187
+        wait 1
+        dw s187, $
+        if fast
+        db 187
+        else
+        ds 2
+        endif
+s188:    lxi h, s195
+        outp port, 188
+        wait 2
+        dw s188, $
+        if fast
+        db 188
+        else
+        ds 2
+        endif
+s189:    lxi h, s196
+        outp port, 189
+        wait 3
+        dw s189, $
+        if fast
+        db 189
+        else
+        ds 2
+        endif
+s190:    lxi h, s197
+        outp port, 190
+        wait 4
+        dw s190, $
+        if fast
+        db 190
+        else
+        ds 2
+        endif
+s191:    lxi h, s198
+        outp port, 191
+        wait 5
+        dw s191, $
+        if fast
+        db 191
+        else
+        ds 2
+        endif
+s192:    lxi h, s199
+        outp port, 192
+        wait 6
+        dw s192, $
+        if fast
+        db 192
+        else
+        ds 2
+        endif
+s193:    lxi h, s200
+        outp port, 193
+        wait 7
+        dw s193, $
+        if fast
+        db 193
+        else
+        ds 2
+        endif
+s194:    lxi h, s201
+        outp port, 194
+        wait 8
+        dw s194, $
+        if fast
+        db 194
+        else
+        ds 2
+        endif
+s195:    lxi h, s202
+        outp port, 195
+        wait 9
+        dw s195, $
+        if fast
+        db 195
+        else
+        ds 2
+        endif
+s196:    lxi h, s203
+        outp port, 196
+        wait 10
+        dw s196, $
+        if fast
+        db 196
+        else
+        ds 2
+        endif
+s197:    lxi h, s204
+        outp port, 197
+        wait 11
+        dw s197, $
+        if fast
+        db 197
+        else
+        ds 2
+        endif
+s198:    lxi h, s205
+        outp port, 198
+        wait 12
+        dw s198, $
+        if fast
+        db 198
+        else
+        ds 2
+        endif
+s199:    lxi h, s206
+        outp port, 199
+        wait 13
+        dw s199, $
+        if fast
+        db 199
+        else
+        ds 2
+        endif
+s200:    lxi h, s207
+        outp port, 0
+        wait 14
+        dw s200, $
+        if fast
+        db 200
+        else
+        ds 2
+        endif
+s201:    lxi h, s208
+        outp port, 1
+        wait 15
+        dw s201, $
+        if fast
+        db 201
+        else
+        ds 2
+        endif
+s202:    lxi h, s209
+        outp port, 2
+        wait 16
+        dw s202, $
+        if fast
+        db 202
+        else
+        ds 2
+        endif
+s203:    lxi h, s210
+        outp port, 3
+        wait 17
+        dw s203, $
+        if fast
+        db 203
+        else
+        ds 2
+        endif
+s204:    lxi h, s211
+        outp port, 4
+        wait 1
+        dw s204, $
+        if fast
+        db 204
+        else
+        ds 2
+        endif
+s205:    lxi h, s212
+        outp port, 5
+        wait 2
+        dw s205, $
+        if fast
+        db 205
+        else
+        ds 2
+        endif
+s206:    lxi h, s213
+        outp port, 6
+        wait 3
+        dw s206, $
+        if fast
+        db 206
+        else
+        ds 2
+        endif
+s207:    lxi h, s214
+        outp port, 7
+        wait 4
+        dw s207, $
+        if fast
+        db 207
+        else
+        ds 2
+        endif
+s208:    lxi h, s215
+        outp port, 8
+        wait 5
+        dw s208, $
+        if fast
+        db 208
+        else
+        ds 2
+        endif
+s209:    lxi h, s216
+        outp port, 9
+        wait 6
+        dw s209, $
+        if fast
+        db 209
+        else
+        ds 2
+        endif
+s210:    lxi h, s217
+        outp port, 10
+        wait 7
+        dw s210, $
+        if fast
+        db 210
+        else
+        ds 2
+        endif
+s211:    lxi h, s218
+        outp port, 11
+        wait 8
+        dw s211, $
+        if fast
+        db 211
+        else
+        ds 2
+        endif
+s212:    lxi h, s219
+        outp port, 12
+        wait 9
+        dw s212, $
+        if fast
+        db 212
+        else
+        ds 2
+        endif
+s213:    lxi h, s220
+        outp port, 13
+        wait 10
+        dw s213, $
+        if fast
+        db 213
+        else
+        ds 2
+        endif
+s214:    lxi h, s221
+        outp port, 14
+        wait 11
+        dw s214, $
+        if fast
+        db 214
+        else
+        ds 2
+        endif
+s215:    lxi h, s222
+        outp port, 15
+        wait 12
+        dw s215, $
+        if fast
+        db 215
+        else
+        ds 2
+        endif
+s216:    lxi h, s223
+        outp port, 16
+        wait 13
+        dw s216, $
+        if fast
+        db 216
+        else
+        ds 2
+        endif
+s217:    lxi h, s224
+        outp port, 17
+        wait 14
+        dw s217, $
+        if fast
+        db 217
+        else
+        ds 2
+        endif
+s218:    lxi h, s225
+        outp port, 18
+        wait 15
+        dw s218, $
+        if fast
+        db 218
+        else
+        ds 2
+        endif
+s219:    lxi h, s226
+        outp port, 19
+        wait 16
+        dw s219, $
+        if fast
+        db 219
+        else
+        ds 2
+        endif
+s220:    lxi h, s227
+        outp port, 20
+        wait 17
+        dw s220, $
+        if fast
+        db 220
+        else
+        ds 2
+        endif
+s221:    lxi h, s228
+        outp port, 21
+        wait 1
+        dw s221, $
+        if fast
+        db 221
+        else
+        ds 2
+        endif
+s222:    lxi h, s229
+        outp port, 22
+        wait 2
+        dw s222, $
+        if fast
+        db 222
+        else
+        ds 2
+        endif
+s223:    lxi h, s230
+        outp port, 23
+        wait 3
+        dw s223, $
+        if fast
+        db 223
+        else
+        ds 2
+        endif
+s224:    lxi h, s231
+        outp port, 24
+        wait 4
+        dw s224, $
+        if fast
+        db 224
+        else
+        ds 2
+        endif
+s225:    lxi h, s232
+        outp port, 25
+        wait 5
+        dw s225, $
+        if fast
+        db 225
+        else
+        ds 2
+        endif
+s226:    lxi h, s233
+        outp port, 26
+        wait 6
+        dw s226, $
+        if fast
+        db 226
+        else
+        ds 2
+        endif
+s227:    lxi h, s234
+        outp port, 27
+        wait 7
+        dw s227, $
+        if fast
+        db 227
+        else
+        ds 2
+        endif
+s228:    lxi h, s235
+        outp port, 28
+        wait 8
+        dw s228, $
+        if fast
+        db 228
+        else
+        ds 2
+        endif
+s229:    lxi h, s236
+        outp port, 29
+        wait 9
+        dw s229, $
+        if fast
+        db 229
+        else
+        ds 2
+        endif
+s230:    lxi h, s237
+        outp port, 30
+        wait 10
+        dw s230, $
+        if fast
+        db 230
+        else
+        ds 2
+        endif
+s231:    lxi h, s238
+        outp port, 31
+        wait 11
+        dw s231, $
+        if fast
+        db 231
+        else
+        ds 2
+        endif
+s232:    lxi h, s239
+        outp port, 32
+        wait 12
+        dw s232, $
+        if fast
+        db 232
+        else
+        ds 2
+        endif
+s233:    lxi h, s0
+        outp port, 33
+        wait 13
+        dw s233, $
+        if fast
+        db 233
+        else
+        ds 2
+        endif
+s234:    lxi h, s1
+        outp port, 34
+        wait 14
+        dw s234, $
+        if fast
+        db 234
+        else
+        ds 2
+        endif
+s235:    lxi h, s2
+        outp port, 35
+        wait 15
+        dw s235, $
+        if fast
+        db 235
+        else
+        ds 2
+        endif
+s236:    lxi h, s3
+        outp port, 36
+        wait 16
+        dw s236, $
+        if fast
+        db 236
+        else
+        ds 2
+        endif
+s237:    lxi h, s4
+        outp port, 37
+        wait 17
+        dw s237, $
+        if fast
+        db 237
+        else
+        ds 2
+        endif
+s238:    lxi h, s5
+        outp port, 38
+        wait 1
+        dw s238, $
+        if fast
+        db 238
+        else
+        ds 2
+        endif
+s239:    lxi h, s6
+        outp port, 39
+        wait 2
+        dw s239, $
+        if fast
+        db 239
+        else
+        ds 2
+        endif
+        jmp s0
+        end
@@ -0,0 +1,11 @@
+; a small program whose previous build is patch.old, for the IPS delta
+        org 100h
+start:  lxi sp, 0F000h
+        mvi a, 2
+        out 10h
+        call sub
+        jmp start
+sub:    mvi b, 20h
+        ret
+        db 'VERSION 2'
+        end
@@ -0,0 +1,8 @@
+; a macro that calls itself forever must stop at the depth budget with a shortened backtrace
+        org 100h
+loop    macro n
+        db n
+        loop n+1
+        endm
+        loop 0
+        end
@@ -0,0 +1,36 @@
+; REPT/IRP/IRPC blocks and SET symbols: recorded macro bytes must not be replayed while a
+; SET symbol can change between two calls with the same arguments
+        org 100h
+count   set 1
+; reads the SET counter, so equal calls can emit different bytes
+ldcnt   macro r
+        mvi r, count
+        endm
+; IRP and IRPC nested inside a macro
+clear   macro regs, text
+        irp x, regs
+        mvi x, 0
+        endm
+        irpc c, text
+        db '&c'
+        endm
+        endm
+        ldcnt a
+        ldcnt a
+count   set count + 1
+        ldcnt a
+count   defl 10h
+        ldcnt a
+        clear <b, c, d>, xyz
+        clear <b, c, d>, xyz
+; top-level REPT with a SET counter and a LOCAL label per iteration
+n       set 0
+        rept 3
+        local skip
+n       set n + 1
+        mvi e, n
+        jmp skip
+        db n
+skip:   nop
+        endm
+        end
@@ -0,0 +1,97 @@
+// Round-trip test for the -g line table: format_line_table -> LineTable::parse -> lookups.
+// Usage: line_table_test [file.dbg ...]. Each .dbg given (written by ayM80 -g) is also loaded and
+// every address and line in it is looked up again.
+#include "line_table.h"
+#include <iostream>
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const std::string& what) {
+    if (condition) return;
+    std::cout << "FAIL: " << what << std::endl;
+    failures++;
+}
+
+bool same_entry(const LineTableEntry* a, const LineTableEntry& b) {
+    return a && a->address == b.address && a->last == b.last && a->line == b.line && a->file == b.file && a->depth == b.depth;
+}
+
+// Every address of every run finds that run, and every run is among the runs of its line.
+void check_lookups(const LineTable& table, const std::string& name) {
+    for (const auto& entry : table.entries()) {
+        for (uint32_t address = entry.address; address <= entry.last; ++address) {
+            check(same_entry(table.find_address(address), entry), name + ": address " + std::to_string(address) + " finds its run");
+        }
+        bool listed = false;
+        for (const LineTableEntry* run : table.find_line(entry.file, entry.line)) {
+            check(run->file == entry.file && run->line == entry.line, name + ": line " + std::to_string(entry.line) + " finds only its own runs");
+            listed = listed || run == &entry;
+        }
+        check(listed, name + ": line " + std::to_string(entry.line) + " finds the run at " + std::to_string(entry.address));
+    }
+}
+
+void test_round_trip() {
+    std::vector<std::string> files = { "main.asm", "lib/io.mac" };
+    // Line 3 of main.asm emits two runs (before and after a macro expanded from io.mac); 0x0110 is a gap.
+    std::vector<LineTableEntry> entries = {
+        { 0x0100, 0x0102, 3, 0, 0 },
+        { 0x0103, 0x0104, 7, 1, 1 },
+        { 0x0105, 0x0105, 3, 0, 0 },
+        { 0x0106, 0x010F, 9, 0, 0 },
+        { 0x0111, 0x0111, 1, 1, 2 },
+        { 0xFFFE, 0xFFFF, 12, 0, 0 },
+    };
+    LineTable table;
+    std::string error;
+    check(table.parse(format_line_table(files, entries), error), "round trip parses: " + error);
+    check(table.files() == files, "file names survive the round trip");
+    check(table.entries().size() == entries.size(), "every entry survives the round trip");
+    for (size_t i = 0; i < entries.size() && i < table.entries().size(); ++i) {
+        check(same_entry(&table.entries()[i], entries[i]), "entry " + std::to_string(i) + " survives the round trip");
+    }
+
+    check(table.find_address(0x00FF) == nullptr, "an address below the first run finds nothing");
+    check(table.find_address(0x0110) == nullptr, "an address in a gap finds nothing");
+    check(table.find_address(0x0112) == nullptr, "an address after a run finds nothing");
+    check(same_entry(table.find_address(0x0104), entries[1]), "the last address of a run finds it");
+    check(same_entry(table.find_address(0xFFFF), entries[5]), "address 0xFFFF finds the last run");
+
+    std::vector<const LineTableEntry*> runs = table.find_line(0, 3);
+    check(runs.size() == 2 && same_entry(runs[0], entries[0]) && same_entry(runs[1], entries[2]), "a line finds all its runs in address order");
+    check(table.find_line(1, 3).empty(), "the same line number in another file finds nothing");
+    check(table.find_line(0, 4).empty(), "a line that emitted nothing finds nothing");
+    check_lookups(table, "round trip");
+
+    check(table.parse(format_line_table({}, {}), error) && table.entries().empty(), "an empty table parses");
+}
+
+void test_malformed() {
+    std::string data = format_line_table({ "a.asm" }, { { 0, 1, 1, 0, 0 } });
+    LineTable table;
+    std::string error;
+    check(!table.parse(data.substr(0, data.size() - 1), error) && error == "truncated line table", "a truncated table is rejected");
+    check(!table.parse("AYDX" + data.substr(4), error) && error == "not a line table", "a foreign file is rejected");
+    std::string bad_index = data;
+    bad_index[bad_index.size() - 4] = 1;
+    check(!table.parse(bad_index, error) && error == "corrupt line table", "an index past the entries is rejected");
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    test_round_trip();
+    test_malformed();
+    for (int i = 1; i < argc; ++i) {
+        LineTable table;
+        std::string error;
+        if (!table.load(argv[i], error)) { check(false, std::string(argv[i]) + ": " + error); continue; }
+        check(!table.entries().empty(), std::string(argv[i]) + " has entries");
+        check_lookups(table, argv[i]);
+    }
+    if (failures != 0) { std::cout << failures << " line table check(s) failed" << std::endl; return 1; }
+    std::cout << "Line table tests passed" << std::endl;
+    return 0;
+}
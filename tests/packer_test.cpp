@@ -0,0 +1,158 @@
+// Round-trip test for the self-extracting output (-f sfx): lz_compress streams are decoded as
+// described in packer.h, and packed .com files are run on an 8080 interpreter that knows the
+// stub's instructions, which must leave the program at its origin.
+// Usage: packer_test [packed.com program.com ...]: each pair is a -f sfx build and the plain
+// binary of the same program, which runs at 100H.
+#include "packer.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const std::string& what) {
+    if (condition) return;
+    std::cout << "FAIL: " << what << std::endl;
+    failures++;
+}
+
+// Decodes a stream by the format in packer.h. Returns false on a malformed stream.
+bool lz_decode(const std::vector<uint8_t>& stream, std::vector<uint8_t>& data) {
+    data.clear();
+    for (size_t at = 0; at < stream.size();) {
+        uint8_t token = stream[at++];
+        if (token == 0) return at == stream.size();
+        if (token < 0x80) {
+            if (at + token > stream.size()) return false;
+            data.insert(data.end(), stream.begin() + at, stream.begin() + at + token);
+            at += token;
+            continue;
+        }
+        if (at + 2 > stream.size()) return false;
+        size_t distance = static_cast<uint16_t>(-(stream[at] | stream[at + 1] << 8));
+        at += 2;
+        if (distance == 0 || distance > data.size()) return false;
+        for (size_t n = (token & 0x7F) + 3; n > 0; --n) data.push_back(data[data.size() - distance]);
+    }
+    return false;
+}
+
+// The 8080 instructions the stub uses, with their T-states. Runs from 100H until the program
+// counter comes back to `stop` (a jump to the unpacked program); returns false on any other
+// instruction or after too many steps.
+class Stub8080 {
+public:
+    uint8_t memory[0x10000] = {};
+    uint64_t states = 0;
+
+    bool run(uint16_t stop) {
+        uint16_t pc = 0x100;
+        for (uint64_t steps = 0; steps == 0 || pc != stop; ++steps) {
+            if (steps > 100000000) return false;
+            uint8_t opcode = memory[pc++];
+            uint16_t word = memory[pc] | memory[static_cast<uint16_t>(pc + 1)] << 8;
+            switch (opcode) {
+            case 0x01: c = word; b = word >> 8; pc += 2; states += 10; break;             // LXI B
+            case 0x05: b--; flags(b); states += 5; break;                                 // DCR B
+            case 0x0B: set_bc(bc() - 1); states += 5; break;                              // DCX B
+            case 0x11: de = word; pc += 2; states += 10; break;                           // LXI D
+            case 0x12: memory[de] = a; states += 7; break;                                // STAX D
+            case 0x13: de++; states += 5; break;                                          // INX D
+            case 0x19: hl += de; states += 10; break;                                     // DAD D
+            case 0x1B: de--; states += 5; break;                                          // DCX D
+            case 0x21: hl = word; pc += 2; states += 10; break;                           // LXI H
+            case 0x22: memory[word] = hl & 0xFF; memory[static_cast<uint16_t>(word + 1)] = hl >> 8; pc += 2; states += 16; break;    // SHLD
+            case 0x23: hl++; states += 5; break;                                          // INX H
+            case 0x2A: hl = memory[word] | memory[static_cast<uint16_t>(word + 1)] << 8; pc += 2; states += 16; break;                // LHLD
+            case 0x2B: hl--; states += 5; break;                                          // DCX H
+            case 0x47: b = a; states += 5; break;                                         // MOV B,A
+            case 0x4E: c = memory[hl]; states += 7; break;                                // MOV C,M
+            case 0x67: hl = (hl & 0xFF) | a << 8; states += 5; break;                     // MOV H,A
+            case 0x69: hl = (hl & 0xFF00) | c; states += 5; break;                        // MOV L,C
+            case 0x78: a = b; states += 5; break;                                         // MOV A,B
+            case 0x7E: a = memory[hl]; states += 7; break;                                // MOV A,M
+            case 0xB1: a |= c; flags(a); states += 4; break;                              // ORA C
+            case 0xB7: flags(a); states += 4; break;                                      // ORA A
+            case 0xC2: pc = zero ? pc + 2 : word; states += 10; break;                    // JNZ
+            case 0xC3: pc = word; states += 10; break;                                    // JMP
+            case 0xC6: a += memory[pc++]; flags(a); states += 7; break;                   // ADI
+            case 0xCA: pc = zero ? word : pc + 2; states += 10; break;                    // JZ
+            case 0xE6: a &= memory[pc++]; flags(a); states += 7; break;                   // ANI
+            case 0xFA: pc = sign ? word : pc + 2; states += 10; break;                    // JM
+            default: return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    uint16_t bc() const { return b << 8 | c; }
+    void set_bc(uint16_t value) { b = value >> 8; c = value & 0xFF; }
+    void flags(uint8_t value) { zero = value == 0; sign = value & 0x80; }
+
+    uint8_t a = 0, b = 0, c = 0;
+    uint16_t de = 0, hl = 0;
+    bool zero = false, sign = false;
+};
+
+// Packs `image` for `origin`, runs the result and compares the unpacked program.
+void check_unpacks(const std::vector<uint8_t>& image, uint16_t origin, const std::string& name) {
+    SelfExtractingImage packed;
+    std::string error;
+    if (!pack_self_extracting(image, origin, packed, error)) { check(false, name + ": " + error); return; }
+    auto machine = std::make_unique<Stub8080>();
+    std::copy(packed.file.begin(), packed.file.end(), machine->memory + 0x100);
+    check(machine->run(origin), name + ": the stub runs to the origin");
+    check(std::equal(image.begin(), image.end(), machine->memory + origin), name + ": the stub unpacks the program");
+    check(machine->states == packed.states, name + ": the T-state estimate is exact (" + std::to_string(packed.states) + " estimated, " +
+          std::to_string(machine->states) + " run)");
+}
+
+std::vector<uint8_t> read_file(const std::string& filename) {
+    std::ifstream infile(filename, std::ios::binary);
+    return std::vector<uint8_t>((std::istreambuf_iterator<char>(infile)), std::istreambuf_iterator<char>());
+}
+
+void test_round_trips() {
+    std::vector<std::vector<uint8_t>> inputs(6);
+    inputs[1] = { 42 };
+    inputs[2].assign(1000, 0xE5);                                       // one long run
+    for (int i = 0; i < 300; ++i) inputs[3].push_back(i * 7 & 0xFF);   // literals past 127
+    uint32_t seed = 1;
+    for (int i = 0; i < 20000; ++i) {                                   // noise with repeats far apart
+        seed = seed * 1103515245 + 12345;
+        inputs[4].push_back(i % 5000 < 2500 ? seed >> 16 : inputs[4][i - 2500]);
+    }
+    for (int i = 0; i < 60000; ++i) inputs[5].push_back(i < 100 || i >= 59900 ? i & 0xFF : (seed = seed * 69069 + 1) >> 24);
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        std::vector<uint8_t> decoded;
+        check(lz_decode(lz_compress(inputs[i]), decoded) && decoded == inputs[i], "input " + std::to_string(i) + " round-trips through lz_compress");
+    }
+    check(lz_compress(inputs[2]).size() < 40, "a long run compresses to a few tokens");
+
+    check_unpacks(inputs[1], 0x100, "one byte at 100H");
+    check_unpacks(inputs[3], 0x100, "literals at 100H");
+    check_unpacks(inputs[4], 0x100, "noise at 100H");
+    check_unpacks(inputs[2], 0x8000, "a run above the stub");
+    check_unpacks(inputs[3], 0x0000, "literals below the stub");
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    test_round_trips();
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::vector<uint8_t> packed = read_file(argv[i]), program = read_file(argv[i + 1]);
+        auto machine = std::make_unique<Stub8080>();
+        std::copy(packed.begin(), packed.begin() + std::min<size_t>(packed.size(), 0xFF00), machine->memory + 0x100);
+        check(!packed.empty() && machine->run(0x100), std::string(argv[i]) + " runs to 100H");
+        check(!program.empty() && std::equal(program.begin(), program.end(), machine->memory + 0x100), std::string(argv[i]) + " unpacks " + argv[i + 1]);
+    }
+    if (failures != 0) { std::cout << failures << " packer check(s) failed" << std::endl; return 1; }
+    std::cout << "Packer tests passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,96 @@
+#!/bin/sh
+# Golden-output tests for the assembler: sh tests/run_tests.sh <path to ayM80>
+#
+# Every tests/fixtures/<name>.asm is assembled with -j 1, -j 2 and -j 4. A fixture with a
+# tests/expected/<name>.err must fail, printing exactly that. Any other must build, and its
+# .com, .lst, .dbg, .hex and .s19 (plus the .ips against tests/fixtures/<name>.old, when there is
+# one) must match tests/expected/<name>.* for every thread count, so parallel runs are checked
+# against serial ones. The main build also writes a dependency file with -MD, which must match
+# tests/expected/<name>.d, and a build into a subdirectory must put its .d next to the output.
+# Options in tests/fixtures/<name>.args are added to every run of that fixture.
+# A fixture with a <name>.mac is assembled with -M against the library compiled from it, and once
+# more with the .mac pasted in front of it; both must give the expected binary. A fixture with a
+# ready-made <name>.mlb is assembled with -M against that library. Where there is a
+# tests/expected/<name>_sfx.com, the -f sfx build must match it too. The binary is also built
+# with --mmap-output, once committed through the mapping and once with the commit blocked by a
+# directory in the way of its temporary name, which must fall back to an ordinary write.
+# With UPDATE=1 the expected files are rewritten from the -j 1 outputs instead.
+
+if [ $# -ne 1 ]; then echo "usage: $0 <assembler>" >&2; exit 2; fi
+case "$1" in /*) ASM="$1" ;; *) ASM="$(pwd)/$1" ;; esac
+TESTS="$(cd "$(dirname "$0")" && pwd)"
+WORK="$(mktemp -d)"
+trap 'rm -rf "$WORK"' EXIT
+
+failures=0
+fail() { echo "FAIL: $1"; failures=$((failures + 1)); }
+
+# check <name> <threads> <file>: compares one output file with its expected copy.
+check() {
+    if [ "$UPDATE" = 1 ] && [ "$2" = 1 ]; then cp "$WORK/$3" "$TESTS/expected/$3"; return; fi
+    cmp -s "$WORK/$3" "$TESTS/expected/$3" || fail "$1 -j $2: $3 differs from tests/expected/$3"
+}
+
+for source in "$TESTS"/fixtures/*.asm; do
+    name="$(basename "$source" .asm)"
+    args=""
+    if [ -f "$TESTS/fixtures/$name.args" ]; then args="$(cat "$TESTS/fixtures/$name.args")"; fi
+    for threads in 1 2 4; do
+        rm -rf "$WORK"/*
+        cp "$source" "$WORK/"
+        cd "$WORK" || exit 1
+
+        library=""
+        if [ -f "$TESTS/fixtures/$name.mac" ]; then
+            cp "$TESTS/fixtures/$name.mac" .
+            if ! "$ASM" "$name.mac" --make-library "$name.mlb" > "$name.out" 2>&1; then fail "$name: library build failed"; cat "$name.out"; continue; fi
+        elif [ -f "$TESTS/fixtures/$name.mlb" ]; then
+            cp "$TESTS/fixtures/$name.mlb" .
+        fi
+        if [ -f "$name.mlb" ]; then library="-M $name.mlb"; fi
+
+        if [ -f "$TESTS/expected/$name.err" ]; then
+            if "$ASM" "$name.asm" -j "$threads" $args $library -o "$name.com" > "$name.err" 2>&1; then
+                fail "$name -j $threads: assembled, but should have failed"
+            else
+                check "$name" "$threads" "$name.err"
+            fi
+            continue
+        fi
+
+        set -- "$name.asm" -j "$threads" $args $library -l -g -MD -o "$name.com"
+        if [ -f "$TESTS/fixtures/$name.old" ]; then cp "$TESTS/fixtures/$name.old" .; set -- "$@" --delta-from "$name.old"; fi
+        if ! "$ASM" "$@" > "$name.out" 2>&1; then fail "$name -j $threads: assembly failed"; cat "$name.out"; continue; fi
+        if ! "$ASM" "$name.asm" -j "$threads" $args $library -f ihex -o "$name.hex" > "$name.out" 2>&1; then fail "$name -j $threads: HEX assembly failed"; continue; fi
+        if ! "$ASM" "$name.asm" -j "$threads" $args $library -f srec -o "$name.s19" > "$name.out" 2>&1; then fail "$name -j $threads: S-record assembly failed"; continue; fi
+
+        check "$name" "$threads" "$name.com"
+        check "$name" "$threads" "$name.lst"
+        check "$name" "$threads" "$name.dbg"
+        check "$name" "$threads" "$name.hex"
+        check "$name" "$threads" "$name.s19"
+        check "$name" "$threads" "$name.d"
+        mkdir build
+        if ! "$ASM" "$name.asm" -j "$threads" $args $library -MD -o "build/$name.com" > "$name.out" 2>&1; then fail "$name -j $threads: build into a subdirectory failed"; continue; fi
+        [ -f "build/$name.d" ] || fail "$name -j $threads: -MD did not write build/$name.d next to the output"
+        if [ -f "$TESTS/fixtures/$name.old" ]; then check "$name" "$threads" "$name.ips"; fi
+        for mapped in mapped fallback; do
+            if [ "$mapped" = fallback ]; then mkdir "${name}_$mapped.com.tmp"; fi
+            if ! "$ASM" "$name.asm" -j "$threads" $args $library --mmap-output -o "${name}_$mapped.com" > "$name.out" 2>&1; then fail "$name -j $threads: --mmap-output assembly failed ($mapped)"; continue; fi
+            cmp -s "${name}_$mapped.com" "$TESTS/expected/$name.com" || fail "$name -j $threads: the --mmap-output binary differs ($mapped)"
+        done
+        if [ -f "$TESTS/expected/${name}_sfx.com" ]; then
+            if ! "$ASM" "$name.asm" -j "$threads" $args $library -f sfx -o "${name}_sfx.com" > "$name.out" 2>&1; then fail "$name -j $threads: sfx assembly failed"; continue; fi
+            check "$name" "$threads" "${name}_sfx.com"
+        fi
+
+        if [ -f "$name.mac" ]; then
+            cat "$name.mac" "$name.asm" > "${name}_inline.asm"
+            if ! "$ASM" "${name}_inline.asm" -j "$threads" $args -o "${name}_inline.com" > "$name.out" 2>&1; then fail "$name -j $threads: inline build failed"; continue; fi
+            cmp -s "${name}_inline.com" "$TESTS/expected/$name.com" || fail "$name -j $threads: the inline build differs from the library build"
+        fi
+    done
+done
+
+if [ "$failures" -ne 0 ]; then echo "$failures test(s) failed"; exit 1; fi
+echo "All tests passed"